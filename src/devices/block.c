@@ -19,6 +19,8 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long hit_cnt;         /* Accesses satisfied by a cache. */
+    unsigned long long miss_cnt;        /* Accesses a cache had to pass on. */
   };
 
 /* List of all block devices. */
@@ -171,13 +173,31 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          unsigned long long access_cnt = block->hit_cnt + block->miss_cnt;
+
+          printf ("%s (%s): %llu reads, %llu writes",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (access_cnt > 0)
+            printf (", %llu of %llu cached accesses hit (%llu%%)",
+                    block->hit_cnt, access_cnt,
+                    block->hit_cnt * 100 / access_cnt);
+          printf ("\n");
         }
     }
 }
 
+/* Records an access to BLOCK through a cache in front of it,
+   which HIT if it did not need the device. */
+void
+block_count_cache_access (struct block *block, bool hit)
+{
+  if (hit)
+    block->hit_cnt++;
+  else
+    block->miss_cnt++;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -200,6 +220,8 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->hit_cnt = 0;
+  block->miss_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
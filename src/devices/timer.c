@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -167,10 +168,10 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
   ticks++;
-  thread_tick ();
+  thread_tick (args->cs != SEL_KCSEG);
 
   /* Mlfqs: update priority & values*/
   if(thread_mlfqs){     // every tick
@@ -0,0 +1,98 @@
+/* mscan.c
+
+   Maps each file named on the command line and reads it, first
+   from start to end and then in a scattered order, reporting
+   the page faults and timer ticks each scan took.  Useful for
+   measuring fault-around and read-ahead, e.g. with different
+   -fa and -ra kernel options. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+#define PAGE_SIZE 4096
+
+/* Returns the greatest common divisor of A and B. */
+static int
+gcd (int a, int b)
+{
+  while (b != 0)
+    {
+      int t = a % b;
+      a = b;
+      b = t;
+    }
+  return a;
+}
+
+/* Prints the page faults and ticks between BEFORE and AFTER. */
+static void
+report (const char *file, const char *scan,
+        const struct rusage *before, const struct rusage *after)
+{
+  printf ("%s: %s scan: %lu major, %lu minor faults, %lld ticks\n",
+          file, scan, after->majflt - before->majflt,
+          after->minflt - before->minflt,
+          (after->utime + after->stime) - (before->utime + before->stime));
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  int i;
+  
+  for (i = 1; i < argc; i++) 
+    {
+      const char *data = (const char *) 0x10000000;
+      struct rusage before, after;
+      int fd, size, page_cnt, ofs, page, stride;
+      unsigned sum = 0;
+      mapid_t map;
+
+      fd = open (argv[i]);
+      if (fd < 0) 
+        {
+          printf ("%s: open failed\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+      size = filesize (fd);
+      page_cnt = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+      /* Sequential scan. */
+      map = mmap (fd, (void *) data);
+      if (map == MAP_FAILED) 
+        {
+          printf ("%s: mmap failed\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+      getrusage (&before);
+      for (ofs = 0; ofs < size; ofs++)
+        sum += data[ofs];
+      getrusage (&after);
+      report (argv[i], "sequential", &before, &after);
+      munmap (map);
+
+      /* Scattered scan: visits every page once, striding by a
+         number of pages coprime to PAGE_CNT. */
+      map = mmap (fd, (void *) data);
+      if (map == MAP_FAILED) 
+        {
+          printf ("%s: mmap failed\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+      getrusage (&before);
+      for (stride = 7; gcd (stride, page_cnt) != 1; stride++)
+        continue;
+      for (ofs = 0, page = 0; ofs < page_cnt; ofs++)
+        {
+          sum += data[page * PAGE_SIZE];
+          page = (page + stride) % page_cnt;
+        }
+      getrusage (&after);
+      report (argv[i], "scattered", &before, &after);
+      munmap (map);
+
+      printf ("%s: checksum %u\n", argv[i], sum);
+      close (fd);
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,446 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.  Keeps the cache_sectors most recently used
+   sectors of the file system device in memory, so that the file
+   system reads and writes memory instead of the disk.  Writes
+   only mark a sector dirty; dirty sectors go to disk when they
+   are evicted, when the flusher thread wakes up every
+   FLUSH_INTERVAL ticks, and in cache_flush().
+
+   cache_lock protects the mapping from sectors to entries, the
+   clock hand, and each entry's pin count.  Each entry's own
+   lock protects its data and dirty bit, and is held across the
+   disk I/O that fills or cleans it, so that accesses to
+   different sectors do not wait for each other.  An entry is
+   pinned by whoever holds or is waiting for its lock, and only
+   unpinned, clean entries are reused.
+
+   A sector written with cache_write_meta() holds metadata, and
+   is tagged with the journal transaction that last changed it.
+   Until the journal reports with cache_commit() that the
+   transaction is on disk in the journal, the sector must not
+   be written to its home location, so it is neither cleaned nor
+   evicted.
+
+   cache_read_ahead() queues sectors that are likely to be read
+   soon, and the read-ahead thread brings them in, so that the
+   reader finds them in the cache instead of waiting for the
+   disk.  When the queue is full, further requests are dropped.
+
+   Disk I/O is charged to the thread whose request causes it,
+   not to the thread that does it, which is often the flusher or
+   the read-ahead thread: a read when the sector is brought in
+   for the thread or queued for read-ahead, and a write when the
+   thread makes a clean sector dirty.  The journal's own writes
+   are charged to nobody. */
+
+/* Ticks between passes of the flusher thread. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Maximum number of queued read-ahead requests. */
+#define READAHEAD_QUEUE 32
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct hash_elem hash_elem; /* Element in cache_map. */
+    block_sector_t sector;      /* Cached sector, if valid. */
+    bool valid;                 /* In cache_map? */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pin_cnt;                /* Threads holding or waiting for LOCK. */
+    struct lock lock;           /* Protects DATA, DIRTY, and TXN. */
+    bool dirty;                 /* Does DATA differ from the disk? */
+    unsigned txn;               /* Last transaction to change DATA. */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+size_t cache_sectors = CACHE_DEFAULT;
+
+static struct cache_entry *entries; /* All entries. */
+static size_t clock_hand;           /* Next entry to consider for reuse. */
+static struct hash cache_map;       /* Valid entries, by sector. */
+static struct lock cache_lock;      /* Protects the above. */
+static struct condition cache_cond; /* Signaled when an entry is unpinned. */
+static unsigned committed_txn;      /* Last transaction in the journal. */
+
+/* Read-ahead requests, a circular queue. */
+static block_sector_t ra_queue[READAHEAD_QUEUE];
+static size_t ra_head, ra_cnt;      /* First request, number of requests. */
+static struct lock ra_lock;         /* Protects the queue. */
+static struct condition ra_cond;    /* Signaled when a request is queued. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static thread_func flusher_thread;
+static thread_func readahead_thread;
+static struct cache_entry *cache_get (block_sector_t, bool read,
+                                      struct rusage *);
+static void cache_put (struct cache_entry *);
+static void cache_clean (struct cache_entry *);
+static bool may_clean (const struct cache_entry *);
+
+/* Initializes the buffer cache and starts its flusher and
+   read-ahead threads.  Must be called after fs_device has been
+   set. */
+void
+cache_init (void)
+{
+  size_t page_cnt;
+  uint8_t *data;
+  size_t i;
+
+  if (cache_sectors < CACHE_MIN)
+    cache_sectors = CACHE_MIN;
+  page_cnt = DIV_ROUND_UP (cache_sectors * BLOCK_SECTOR_SIZE, PGSIZE);
+  entries = malloc (cache_sectors * sizeof *entries);
+  data = palloc_get_multiple (0, page_cnt);
+  if (entries == NULL || data == NULL
+      || !hash_init (&cache_map, entry_hash, entry_less, NULL))
+    PANIC ("buffer cache allocation failed");
+
+  for (i = 0; i < cache_sectors; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      e->valid = false;
+      e->accessed = false;
+      e->pin_cnt = 0;
+      lock_init (&e->lock);
+      e->dirty = false;
+      e->txn = 0;
+      e->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  clock_hand = 0;
+  lock_init (&cache_lock);
+  cond_init (&cache_cond);
+  committed_txn = 0;
+  ra_head = ra_cnt = 0;
+  lock_init (&ra_lock);
+  cond_init (&ra_cond);
+
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+  thread_create ("readahead", PRI_DEFAULT, readahead_thread, NULL);
+}
+
+/* Copies SIZE bytes starting at offset OFS within SECTOR of the
+   file system device into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true, &thread_current ()->usage);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR of the file system
+   device, starting at offset OFS within the sector.  The data
+   reaches the disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  /* There is no need to read a sector that will be overwritten
+     entirely. */
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE,
+                 &thread_current ()->usage);
+  memcpy (e->data + ofs, buffer, size);
+  if (!e->dirty)
+    thread_current ()->usage.oublock++;
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Like cache_write(), but SECTOR holds file system metadata, so
+   the change becomes part of the running journal transaction.
+   Must be called between journal_begin() and journal_end(). */
+void
+cache_write_meta (block_sector_t sector, const void *buffer,
+                  int ofs, int size)
+{
+  unsigned txn = journal_add (sector);
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE,
+                 &thread_current ()->usage);
+  memcpy (e->data + ofs, buffer, size);
+  if (!e->dirty)
+    thread_current ()->usage.oublock++;
+  e->dirty = true;
+  e->txn = txn;
+  cache_put (e);
+}
+
+/* Records that every transaction up to TXN is in the journal,
+   so that the sectors they changed may be written home. */
+void
+cache_commit (unsigned txn)
+{
+  lock_acquire (&cache_lock);
+  committed_txn = txn;
+  cond_broadcast (&cache_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector in the cache to disk, except
+   metadata changed by transactions not yet in the journal. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_sectors; i++)
+    {
+      struct cache_entry *e = &entries[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid || !e->dirty || !may_clean (e))
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      cache_clean (e);
+      cache_put (e);
+    }
+}
+
+/* Asks for SECTOR to be brought into the cache in the
+   background.  Does not wait. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  struct cache_entry key;
+  bool cached;
+
+  lock_acquire (&cache_lock);
+  key.sector = sector;
+  cached = hash_find (&cache_map, &key.hash_elem) != NULL;
+  lock_release (&cache_lock);
+  if (cached)
+    return;
+
+  lock_acquire (&ra_lock);
+  if (ra_cnt < READAHEAD_QUEUE)
+    {
+      ra_queue[(ra_head + ra_cnt++) % READAHEAD_QUEUE] = sector;
+      thread_current ()->usage.inblock++;
+      cond_signal (&ra_cond, &ra_lock);
+    }
+  lock_release (&ra_lock);
+}
+
+/* Returns the locked, pinned entry for SECTOR, bringing SECTOR
+   into the cache if it is not there.  If READ is false, the
+   caller will overwrite the whole sector, so it is not read
+   from disk.  A read from disk is charged to USAGE, if it is
+   nonnull.  The caller must release the entry with
+   cache_put(). */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool read, struct rusage *usage)
+{
+  struct cache_entry key, *e;
+  struct hash_elem *found;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      size_t scanned;
+
+      key.sector = sector;
+      found = hash_find (&cache_map, &key.hash_elem);
+      if (found != NULL)
+        {
+          /* Hit.  If another thread is still reading the sector
+             in, acquiring the lock waits for it to finish. */
+          e = hash_entry (found, struct cache_entry, hash_elem);
+          e->pin_cnt++;
+          e->accessed = true;
+          block_count_cache_access (fs_device, true);
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      /* Miss.  Run the clock over the unpinned entries, giving
+         those accessed since the last pass a second chance.  Two
+         trips around clear every accessed bit, so finding no
+         victim in that time means all entries are pinned or hold
+         uncommitted metadata. */
+      e = NULL;
+      for (scanned = 0; scanned < 2 * cache_sectors; scanned++)
+        {
+          struct cache_entry *c = &entries[clock_hand];
+          clock_hand = (clock_hand + 1) % cache_sectors;
+          if (c->pin_cnt > 0 || !may_clean (c))
+            continue;
+          if (c->valid && c->accessed)
+            c->accessed = false;
+          else
+            {
+              e = c;
+              break;
+            }
+        }
+      if (e == NULL)
+        {
+          cond_wait (&cache_cond, &cache_lock);
+          continue;
+        }
+
+      /* Nobody holds the lock of an unpinned entry, so this does
+         not block. */
+      e->pin_cnt++;
+      lock_acquire (&e->lock);
+      if (e->dirty)
+        {
+          /* Write the victim back without holding cache_lock,
+             then start over, because SECTOR may have been
+             brought in meanwhile and the victim may have been
+             used again. */
+          lock_release (&cache_lock);
+          cache_clean (e);
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          e->pin_cnt--;
+          cond_signal (&cache_cond, &cache_lock);
+          continue;
+        }
+      break;
+    }
+
+  /* Reuse the clean victim E for SECTOR. */
+  if (e->valid)
+    hash_delete (&cache_map, &e->hash_elem);
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  hash_insert (&cache_map, &e->hash_elem);
+  block_count_cache_access (fs_device, false);
+  lock_release (&cache_lock);
+
+  if (read)
+    {
+      block_read (fs_device, sector, e->data);
+      if (usage != NULL)
+        usage->inblock++;
+    }
+  return e;
+}
+
+/* Unlocks and unpins entry E, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_cond, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Writes entry E to disk if it is dirty and may be written.
+   The caller must hold E's lock. */
+static void
+cache_clean (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->dirty && may_clean (e))
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+    }
+}
+
+/* Returns true if entry E is clean or may be written home, that
+   is, if no transaction that has yet to reach the journal has
+   changed it.  The caller must hold cache_lock or E's lock.
+   committed_txn only grows, so reading it without cache_lock at
+   worst keeps E in memory a little longer. */
+static bool
+may_clean (const struct cache_entry *e)
+{
+  return !e->dirty || e->txn <= committed_txn;
+}
+
+/* Writes dirty sectors to disk every FLUSH_INTERVAL ticks, so
+   that a crash loses little data and evictions seldom have to
+   wait for a write. */
+static void
+flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Brings the sectors queued by cache_read_ahead() into the
+   cache, skipping those already there.  Their reads were
+   charged to the threads that queued them. */
+static void
+readahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct cache_entry key;
+      block_sector_t sector;
+      bool cached;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_cond, &ra_lock);
+      sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % READAHEAD_QUEUE;
+      ra_cnt--;
+      lock_release (&ra_lock);
+
+      lock_acquire (&cache_lock);
+      key.sector = sector;
+      cached = hash_find (&cache_map, &key.hash_elem) != NULL;
+      lock_release (&cache_lock);
+      if (!cached)
+        cache_put (cache_get (sector, true, NULL));
+    }
+}
+
+/* Returns a hash value for entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *c = hash_entry (e, struct cache_entry, hash_elem);
+  return hash_int (c->sector);
+}
+
+/* Returns true if entry A's sector precedes entry B's. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, hash_elem)->sector
+          < hash_entry (b, struct cache_entry, hash_elem)->sector);
+}
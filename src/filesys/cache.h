@@ -0,0 +1,25 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Default number of sectors in the buffer cache. */
+#define CACHE_DEFAULT 64
+
+/* Smallest number of sectors in the buffer cache, which leaves
+   the journal room for a few operations under way. */
+#define CACHE_MIN 32
+
+/* Number of sectors in the buffer cache.  Set with -bc. */
+extern size_t cache_sectors;
+
+void cache_init (void);
+void cache_read (block_sector_t, void *, int ofs, int size);
+void cache_write (block_sector_t, const void *, int ofs, int size);
+void cache_write_meta (block_sector_t, const void *, int ofs, int size);
+void cache_commit (unsigned txn);
+void cache_flush (void);
+void cache_read_ahead (block_sector_t);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,176 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.  Remembers the outcome of recent
+   lookups of a name in a directory, keyed by the directory's
+   inode sector and the name, so that resolving a path costs a
+   hash probe per component instead of reading directory
+   sectors.  A negative entry, with sector 0, records that the
+   name was not found.  (Sector 0 holds the free map's inode, so
+   no directory entry ever refers to it.)
+
+   The directory code keeps the cache consistent: dir_add()
+   replaces any entry for the name it adds and dir_remove()
+   drops the entry for the name it removes.  Both hold the
+   directory's lock, as does dir_lookup() while it fills the
+   cache, so a lookup never caches an outcome that an add or
+   remove has already changed.  Only empty directories are
+   removed, so no positive entries remain for a directory whose
+   sector is reused, and its negative entries stay true because
+   a new directory starts out empty.
+
+   The cache holds at most DCACHE_SIZE entries, and evicts the
+   least recently used one to make room for another. */
+
+/* Maximum number of cached lookups. */
+#define DCACHE_SIZE 512
+
+/* A cached lookup. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dcache_map. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up in DIR. */
+    block_sector_t sector;              /* Inode sector, or 0 if absent. */
+  };
+
+static struct hash dcache_map;          /* All entries. */
+static struct list lru_list;            /* All entries, most recent first. */
+static struct lock dcache_lock;         /* Protects the above. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t dir, const char *name);
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  if (!hash_init (&dcache_map, dentry_hash, dentry_less, NULL))
+    PANIC ("directory entry cache allocation failed");
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows the outcome, sets *SECTORP to the inode
+   sector that NAME refers to, or to 0 if DIR has no entry for
+   NAME, and returns true.  Otherwise, returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      *sectorp = d->sector;
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in SECTOR, or that DIR has no entry
+   for NAME if SECTOR is 0.  If memory is not available, the
+   outcome is simply not cached. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      if (hash_size (&dcache_map) >= DCACHE_SIZE)
+        {
+          struct list_elem *e = list_pop_back (&lru_list);
+          d = list_entry (e, struct dentry, lru_elem);
+          hash_delete (&dcache_map, &d->hash_elem);
+        }
+      else
+        d = malloc (sizeof *d);
+      if (d == NULL)
+        {
+          lock_release (&dcache_lock);
+          return;
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dcache_map, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets any cached outcome for NAME in the directory whose
+   inode is in sector DIR. */
+void
+dcache_remove (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      hash_delete (&dcache_map, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      free (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  The caller must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache_map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for entry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
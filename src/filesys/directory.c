@@ -1,9 +1,14 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -21,12 +26,84 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* A directory is made of sectors that each hold
+   ENTRIES_PER_SECTOR entries followed by a `struct dir_tail', so
+   that no entry crosses a sector boundary.  There are two
+   formats.
+
+   A small directory is "linear": its entries are searched in
+   order.  When a linear directory of HASH_THRESHOLD sectors has
+   no free entry left, it is converted to a "hashed" directory.
+   Sector 0 of a hashed directory holds a `struct dir_header'
+   instead of entries.  Each name hashes to one of the header's
+   buckets, a chain of sectors linked through their tails, so
+   that a lookup only reads that chain.  The buckets grow by
+   linear hashing: whenever there are more entries than one
+   sector per bucket would hold, one bucket is split in two, up
+   to MAX_BUCKETS buckets.
+
+   The tail of sector 0 tells the two apart: its bucket_cnt is
+   the number of buckets in a hashed directory and 0 in a linear
+   one.  In both formats, its next holds the inode sector of the
+   parent directory, which for the root is the root itself.  The
+   names "." and ".." are not stored as entries. */
+
+/* The end of each directory sector. */
+struct dir_tail
+  {
+    uint32_t next;              /* Sector 0: parent directory.
+                                   Others, hashed: next sector of
+                                   bucket, or 0. */
+    uint32_t bucket_cnt;        /* Sector 0: buckets, or 0 if linear. */
+  };
+
+/* Offset of the tail within a sector. */
+#define TAIL_OFS (BLOCK_SECTOR_SIZE - sizeof (struct dir_tail))
+
+/* Number of entries in a directory sector. */
+#define ENTRIES_PER_SECTOR (TAIL_OFS / sizeof (struct dir_entry))
+
+/* Size of a linear directory, in sectors, at which it is
+   converted to a hashed directory, and its initial number of
+   buckets. */
+#define HASH_THRESHOLD 4
+#define INITIAL_BUCKETS 8
+
+/* Maximum number of buckets in a hashed directory. */
+#define MAX_BUCKETS ((TAIL_OFS - 2 * sizeof (uint32_t)) / sizeof (uint16_t))
+
+/* Sector 0 of a hashed directory, up to its tail.  Sectors are
+   numbered from the start of the directory. */
+struct dir_header
+  {
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t sector_cnt;                /* Sectors, including this one. */
+    uint16_t buckets[MAX_BUCKETS];      /* First sector of each bucket. */
+  };
+
+/* Offset of the parent directory's sector in a directory. */
+#define PARENT_OFS (TAIL_OFS + offsetof (struct dir_tail, next))
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent is the directory in sector PARENT.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct inode *inode;
+  uint32_t value = parent;
+  bool success;
+
+  if (!inode_create (sector, DIV_ROUND_UP (entry_cnt, ENTRIES_PER_SECTOR)
+                             * BLOCK_SECTOR_SIZE, true))
+    return false;
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  success = inode_write_at (inode, &value, sizeof value, PARENT_OFS)
+            == sizeof value;
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,6 +160,113 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Reads SIZE bytes at offset OFS in DIR into BUFFER.  Returns
+   true if successful, false at end of file. */
+static bool
+dir_read (const struct dir *dir, void *buffer, size_t size, off_t ofs)
+{
+  return inode_read_at (dir->inode, buffer, size, ofs) == (off_t) size;
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS in DIR.  Returns
+   true if successful, false if the disk is full. */
+static bool
+dir_write (struct dir *dir, const void *buffer, size_t size, off_t ofs)
+{
+  return inode_write_at (dir->inode, buffer, size, ofs) == (off_t) size;
+}
+
+/* Returns the offset of entry IDX in sector SECTOR. */
+static off_t
+entry_ofs (size_t sector, size_t idx)
+{
+  return sector * BLOCK_SECTOR_SIZE + idx * sizeof (struct dir_entry);
+}
+
+/* Returns the offset of the entry after the one at OFS. */
+static off_t
+next_entry_ofs (off_t ofs)
+{
+  ofs += sizeof (struct dir_entry);
+  if (ofs % BLOCK_SECTOR_SIZE
+      >= (off_t) (ENTRIES_PER_SECTOR * sizeof (struct dir_entry)))
+    ofs = ROUND_UP (ofs, BLOCK_SECTOR_SIZE);
+  return ofs;
+}
+
+/* Returns the number of buckets in DIR, or 0 if DIR is linear. */
+static size_t
+bucket_cnt (const struct dir *dir)
+{
+  uint32_t cnt;
+
+  if (!dir_read (dir, &cnt, sizeof cnt,
+                 TAIL_OFS + offsetof (struct dir_tail, bucket_cnt)))
+    return 0;
+  return cnt;
+}
+
+/* Returns the bucket for NAME in a hashed directory with
+   BUCKET_CNT buckets. */
+static size_t
+name_bucket (const char *name, size_t bucket_cnt)
+{
+  unsigned hash = hash_string (name);
+  size_t low = 1;
+  size_t bucket;
+
+  /* Buckets below BUCKET_CNT - LOW have been split, using one
+     more bit of the hash. */
+  while (low * 2 <= bucket_cnt)
+    low *= 2;
+  bucket = hash % (low * 2);
+  return bucket < bucket_cnt ? bucket : hash % low;
+}
+
+/* Returns the offset of the first sector of BUCKET in the
+   header of a hashed directory. */
+static off_t
+head_ofs (size_t bucket)
+{
+  return offsetof (struct dir_header, buckets) + bucket * sizeof (uint16_t);
+}
+
+/* Returns the first sector of BUCKET in hashed directory DIR, or
+   0 if BUCKET is empty. */
+static size_t
+bucket_head (const struct dir *dir, size_t bucket)
+{
+  uint16_t sector;
+
+  return dir_read (dir, &sector, sizeof sector, head_ofs (bucket)) ? sector : 0;
+}
+
+/* Returns the sector after SECTOR in its bucket in hashed
+   directory DIR, or 0 if SECTOR is the last. */
+static size_t
+next_sector (const struct dir *dir, size_t sector)
+{
+  uint32_t next;
+
+  if (!dir_read (dir, &next, sizeof next, entry_ofs (sector, 0) + TAIL_OFS))
+    return 0;
+  return next;
+}
+
+/* Adds DELTA to the uint32_t at OFS in DIR.  Returns its value
+   before the change, or UINT32_MAX if DIR cannot be read or
+   written. */
+static uint32_t
+add_to_field (struct dir *dir, off_t ofs, int delta)
+{
+  uint32_t value, new_value;
+
+  if (!dir_read (dir, &value, sizeof value, ofs))
+    return UINT32_MAX;
+  new_value = value + delta;
+  return dir_write (dir, &new_value, sizeof new_value, ofs) ? value : UINT32_MAX;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -93,45 +277,313 @@ lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
-  size_t ofs;
+  size_t buckets;
+  off_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  buckets = bucket_cnt (dir);
+  if (buckets == 0)
+    {
+      for (ofs = 0; dir_read (dir, &e, sizeof e, ofs);
+           ofs = next_entry_ofs (ofs))
+        if (e.in_use && !strcmp (name, e.name)) 
+          goto found;
+    }
+  else
+    {
+      size_t sector, i;
+
+      for (sector = bucket_head (dir, name_bucket (name, buckets));
+           sector != 0; sector = next_sector (dir, sector))
+        for (i = 0; i < ENTRIES_PER_SECTOR; i++)
+          {
+            ofs = entry_ofs (sector, i);
+            if (dir_read (dir, &e, sizeof e, ofs)
+                && e.in_use && !strcmp (name, e.name))
+              goto found;
+          }
+    }
   return false;
+
+ found:
+  if (ep != NULL)
+    *ep = e;
+  if (ofsp != NULL)
+    *ofsp = ofs;
+  return true;
+}
+
+/* Returns true if NAME is "." or "..", false otherwise. */
+static bool
+is_dot (const char *name)
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   "." names DIR itself and ".." its parent.  A directory that
+   has been removed contains nothing, not even these. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  *inode = NULL;
+  inode_lock_dir (dir->inode);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
+  if (!strcmp (name, "."))
+    *inode = inode_reopen (dir->inode);
+  else if (!strcmp (name, ".."))
+    {
+      uint32_t parent;
+      if (dir_read (dir, &parent, sizeof parent, PARENT_OFS))
+        *inode = inode_open (parent);
+    }
+  else if (dcache_lookup (dir_sector, name, &sector))
+    {
+      if (sector != 0)
+        *inode = inode_open (sector);
+    }
+  else if (lookup (dir, name, &e, NULL))
+    {
+      dcache_insert (dir_sector, name, e.inode_sector);
+      *inode = inode_open (e.inode_sector);
+    }
   else
-    *inode = NULL;
+    dcache_insert (dir_sector, name, 0);
+
+ done:
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
 
+/* Appends a sector of free entries to hashed directory DIR and
+   returns its number, or 0 if the disk is full. */
+static size_t
+new_sector (struct dir *dir)
+{
+  static const char zeros[BLOCK_SECTOR_SIZE];
+  uint32_t sector;
+
+  sector = add_to_field (dir, offsetof (struct dir_header, sector_cnt), 1);
+  if (sector == UINT32_MAX)
+    return 0;
+  if (sector > UINT16_MAX
+      || !dir_write (dir, zeros, sizeof zeros, entry_ofs (sector, 0)))
+    {
+      add_to_field (dir, offsetof (struct dir_header, sector_cnt), -1);
+      return 0;
+    }
+  return sector;
+}
+
+/* Stores E in the first free entry of BUCKET in hashed directory
+   DIR, adding a sector to the bucket if it is full.  Returns true
+   if successful, false if the disk is full. */
+static bool
+bucket_add (struct dir *dir, size_t bucket, const struct dir_entry *e)
+{
+  struct dir_entry slot;
+  size_t sector, last = 0, i;
+  uint16_t head;
+  uint32_t next;
+
+  for (sector = bucket_head (dir, bucket); sector != 0;
+       sector = next_sector (dir, sector))
+    {
+      for (i = 0; i < ENTRIES_PER_SECTOR; i++)
+        {
+          off_t ofs = entry_ofs (sector, i);
+          if (dir_read (dir, &slot, sizeof slot, ofs) && !slot.in_use)
+            return dir_write (dir, e, sizeof *e, ofs);
+        }
+      last = sector;
+    }
+
+  /* Link a new sector in at the end of the bucket. */
+  sector = new_sector (dir);
+  if (sector == 0)
+    return false;
+  if (last == 0)
+    {
+      head = sector;
+      if (!dir_write (dir, &head, sizeof head, head_ofs (bucket)))
+        return false;
+    }
+  else
+    {
+      next = sector;
+      if (!dir_write (dir, &next, sizeof next, entry_ofs (last, 0) + TAIL_OFS))
+        return false;
+    }
+  return dir_write (dir, e, sizeof *e, entry_ofs (sector, 0));
+}
+
+/* Marks every entry of BUCKET in hashed directory DIR free. */
+static void
+clear_bucket (struct dir *dir, size_t bucket)
+{
+  size_t sector, i;
+
+  for (sector = bucket_head (dir, bucket); sector != 0;
+       sector = next_sector (dir, sector))
+    for (i = 0; i < ENTRIES_PER_SECTOR; i++)
+      {
+        off_t ofs = entry_ofs (sector, i);
+        struct dir_entry e;
+
+        if (dir_read (dir, &e, sizeof e, ofs) && e.in_use)
+          {
+            e.in_use = false;
+            dir_write (dir, &e, sizeof e, ofs);
+          }
+      }
+}
+
+/* Adds a bucket to hashed directory DIR, which has BUCKETS
+   buckets, and moves into it the entries of the bucket that its
+   names used to hash to.
+
+   The entries are copied into the new bucket, which takes any
+   sectors it needs, before the bucket count is written and makes
+   it visible, and they are freed in the old bucket only after
+   that.  So if the disk fills up, the copies are dropped and the
+   directory is left as it was, and every name can still be
+   found at each step.
+
+   If the journal has no room for the split, it is left for a
+   later dir_add(). */
+static void
+split_bucket (struct dir *dir, size_t buckets)
+{
+  uint32_t new_cnt = buckets + 1;
+  size_t low = 1, old, sector, len, i;
+
+  while (low * 2 <= buckets)
+    low *= 2;
+  old = buckets - low;
+
+  /* The split changes the LEN sectors of the old bucket, at most
+     LEN new ones, sector 0, and the directory's inode and index
+     blocks, of which there are fewer than LEN + 4. */
+  len = 0;
+  for (sector = bucket_head (dir, old); sector != 0;
+       sector = next_sector (dir, sector))
+    len++;
+  if (!journal_extend (3 * len + 5))
+    return;
+
+  /* Copy the entries that move.  The new bucket holds no entries
+     of its own yet, so on failure all of its entries are
+     copies. */
+  for (sector = bucket_head (dir, old); sector != 0;
+       sector = next_sector (dir, sector))
+    for (i = 0; i < ENTRIES_PER_SECTOR; i++)
+      {
+        struct dir_entry e;
+
+        if (dir_read (dir, &e, sizeof e, entry_ofs (sector, i))
+            && e.in_use && name_bucket (e.name, new_cnt) == buckets
+            && !bucket_add (dir, buckets, &e))
+          {
+            clear_bucket (dir, buckets);
+            return;
+          }
+      }
+
+  if (!dir_write (dir, &new_cnt, sizeof new_cnt,
+                  TAIL_OFS + offsetof (struct dir_tail, bucket_cnt)))
+    {
+      clear_bucket (dir, buckets);
+      return;
+    }
+
+  /* Free the originals, which no lookup reaches any more. */
+  for (sector = bucket_head (dir, old); sector != 0;
+       sector = next_sector (dir, sector))
+    for (i = 0; i < ENTRIES_PER_SECTOR; i++)
+      {
+        off_t ofs = entry_ofs (sector, i);
+        struct dir_entry e;
+
+        if (dir_read (dir, &e, sizeof e, ofs) && e.in_use
+            && name_bucket (e.name, new_cnt) == buckets)
+          {
+            e.in_use = false;
+            dir_write (dir, &e, sizeof e, ofs);
+          }
+      }
+}
+
+/* Converts DIR, a linear directory of SECTOR_CNT sectors, into a
+   hashed directory with the same entries.  Returns true if
+   successful, false if memory or disk space runs out. */
+static bool
+make_hashed (struct dir *dir, size_t sector_cnt)
+{
+  static const char zeros[BLOCK_SECTOR_SIZE];
+  size_t slot_cnt = sector_cnt * ENTRIES_PER_SECTOR;
+  struct dir_entry *entries;
+  size_t entry_cnt = 0;
+  uint32_t parent, value;
+  bool success = false;
+  size_t i;
+
+  if (!dir_read (dir, &parent, sizeof parent, PARENT_OFS))
+    return false;
+  entries = malloc (slot_cnt * sizeof *entries);
+  if (entries == NULL)
+    return false;
+  for (i = 0; i < slot_cnt; i++)
+    if (dir_read (dir, &entries[entry_cnt], sizeof *entries,
+                  entry_ofs (i / ENTRIES_PER_SECTOR, i % ENTRIES_PER_SECTOR))
+        && entries[entry_cnt].in_use)
+      entry_cnt++;
+
+  /* Rewrite DIR as an empty hashed directory, whose new sectors
+     will reuse the old ones, then add the entries back. */
+  for (i = 0; i < sector_cnt; i++)
+    if (!dir_write (dir, zeros, sizeof zeros, entry_ofs (i, 0)))
+      goto done;
+  if (!dir_write (dir, &parent, sizeof parent, PARENT_OFS))
+    goto done;
+  value = entry_cnt;
+  if (!dir_write (dir, &value, sizeof value,
+                  offsetof (struct dir_header, entry_cnt)))
+    goto done;
+  value = 1;
+  if (!dir_write (dir, &value, sizeof value,
+                  offsetof (struct dir_header, sector_cnt)))
+    goto done;
+  value = INITIAL_BUCKETS;
+  if (!dir_write (dir, &value, sizeof value,
+                  TAIL_OFS + offsetof (struct dir_tail, bucket_cnt)))
+    goto done;
+  for (i = 0; i < entry_cnt; i++)
+    if (!bucket_add (dir, name_bucket (entries[i].name, INITIAL_BUCKETS),
+                     &entries[i]))
+      goto done;
+  success = true;
+
+ done:
+  free (entries);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -142,6 +594,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  size_t buckets;
   off_t ofs;
   bool success = false;
 
@@ -149,43 +602,103 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX || is_dot (name))
     return false;
 
+  /* Nothing can be added to a removed directory. */
+  inode_lock_dir (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  buckets = bucket_cnt (dir);
+  if (buckets == 0)
+    {
+      /* Set OFS to offset of free slot.
+         If there are no free slots, then it will be set to the
+         current end-of-file.
      
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+         inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get a
+         short read due to something intermittent such as low
+         memory. */
+      bool free_slot = false;
+
+      for (ofs = 0; dir_read (dir, &e, sizeof e, ofs);
+           ofs = next_entry_ofs (ofs))
+        if (!e.in_use)
+          {
+            free_slot = true;
+            break;
+          }
+
+      if (free_slot || ofs < HASH_THRESHOLD * BLOCK_SECTOR_SIZE)
+        {
+          /* Write slot. */
+          e.in_use = true;
+          strlcpy (e.name, name, sizeof e.name);
+          e.inode_sector = inode_sector;
+          success = dir_write (dir, &e, sizeof e, ofs);
+          goto done;
+        }
+
+      /* The directory is full and too big to search in order. */
+      if (!make_hashed (dir, DIV_ROUND_UP (ofs, BLOCK_SECTOR_SIZE)))
+        goto done;
+      buckets = INITIAL_BUCKETS;
+    }
+
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (!bucket_add (dir, name_bucket (name, buckets), &e))
+    goto done;
+  success = true;
+
+  /* Split a bucket if the buckets are full on average. */
+  if (add_to_field (dir, offsetof (struct dir_header, entry_cnt), 1)
+      >= buckets * ENTRIES_PER_SECTOR
+      && buckets < MAX_BUCKETS)
+    split_bucket (dir, buckets);
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+static bool read_entry (struct dir *, char name[NAME_MAX + 1]);
+
+/* Returns true if directory INODE has no entries, false
+   otherwise.  The caller must hold INODE's directory lock. */
+static bool
+is_empty (struct inode *inode)
+{
+  struct dir *dir = dir_open (inode_reopen (inode));
+  char name[NAME_MAX + 1];
+  bool empty;
+
+  if (dir == NULL)
+    return false;
+  empty = !read_entry (dir, name);
+  dir_close (dir);
+  return empty;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME or if
+   NAME is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool is_dir = false;
   bool success = false;
   off_t ofs;
 
@@ -193,25 +706,39 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock_dir (dir->inode);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
-  /* Open inode. */
+  /* Open inode.  A directory stays locked until it is marked
+     removed, so that nothing is added to it after it is found
+     to be empty. */
   inode = inode_open (e.inode_sector);
   if (inode == NULL)
     goto done;
+  is_dir = inode_is_dir (inode);
+  if (is_dir)
+    inode_lock_dir (inode);
+  if (is_dir && !is_empty (inode))
+    goto done;
 
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (bucket_cnt (dir) != 0)
+    add_to_field (dir, offsetof (struct dir_header, entry_cnt), -1);
+  dcache_remove (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  if (is_dir)
+    inode_unlock_dir (inode);
   inode_close (inode);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
@@ -220,12 +747,29 @@ dir_remove (struct dir *dir, const char *name)
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  bool success;
+
+  inode_lock_dir (dir->inode);
+  success = read_entry (dir, name);
+  inode_unlock_dir (dir->inode);
+  return success;
+}
+
+/* Does the work of dir_readdir() for a caller that holds DIR's
+   directory lock. */
+static bool
+read_entry (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  /* Sector 0 of a hashed directory holds no entries. */
+  if (dir->pos < BLOCK_SECTOR_SIZE && bucket_cnt (dir) != 0)
+    dir->pos = BLOCK_SECTOR_SIZE;
+
+  while (dir_read (dir, &e, sizeof e, dir->pos)) 
     {
-      dir->pos += sizeof e;
+      dir->pos = next_entry_ofs (dir->pos);
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
@@ -11,10 +11,19 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+/* Most metadata sectors, apart from the free map's, that
+   dir_add() and dir_remove() change, for journal_begin().  A
+   conversion to a hashed directory rewrites up to 13 sectors and
+   the directory's inode.  A bucket split, which can need more,
+   asks for its own. */
+#define DIR_ADD_CREDITS 14
+#define DIR_REMOVE_CREDITS 2
+
 struct inode;
 
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+bool dir_create (block_sector_t sector, size_t entry_cnt,
+                 block_sector_t parent);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
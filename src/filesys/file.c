@@ -3,14 +3,24 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Maximum read-ahead window, in sectors. */
+#define READAHEAD_MAX 16
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+
+    /* Read-ahead state. */
+    off_t ra_next;              /* Position a sequential read starts at. */
+    off_t ra_end;               /* End of the data already read ahead. */
+    size_t ra_window;           /* Read-ahead window, in sectors. */
   };
 
+static void file_read_ahead (struct file *, bool sequential);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +33,9 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -64,15 +77,51 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read, and
+   starts reading the data after it into the buffer cache if
+   FILE is being read sequentially. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
+  bool sequential = file->pos == file->ra_next;
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file_read_ahead (file, sequential);
   return bytes_read;
 }
 
+/* Adjusts FILE's read-ahead window after a read that ended at
+   the current position and, if the window is open, asks for the
+   sectors in it that have not been asked for yet to be read in
+   the background.  A SEQUENTIAL read, one that started where the
+   previous read ended, doubles the window up to READAHEAD_MAX
+   sectors; any other read halves it. */
+static void
+file_read_ahead (struct file *file, bool sequential)
+{
+  off_t end;
+
+  if (sequential)
+    file->ra_window = (file->ra_window == 0 ? 1
+                       : file->ra_window * 2 < READAHEAD_MAX
+                       ? file->ra_window * 2 : READAHEAD_MAX);
+  else
+    {
+      file->ra_window /= 2;
+      file->ra_end = file->pos;
+    }
+  file->ra_next = file->pos;
+
+  end = file->pos + (off_t) file->ra_window * BLOCK_SECTOR_SIZE;
+  if (file->ra_end < file->pos)
+    file->ra_end = file->pos;
+  if (end > file->ra_end)
+    {
+      inode_read_ahead (file->inode, file->ra_end, end - file->ra_end);
+      file->ra_end = end;
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -87,9 +136,9 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up or the file
+   reaches its maximum size.
+   Writing past end of file grows the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -102,9 +151,9 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up or the file
+   reaches its maximum size.
+   Writing past end of file grows the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
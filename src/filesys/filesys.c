@@ -2,15 +2,23 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
+static bool create (const char *path, off_t initial_size, bool is_dir);
+static bool add_file (struct dir *, const char *name, off_t initial_size,
+                      bool is_dir);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,12 +29,15 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
 
+  journal_open ();
   free_map_open ();
 }
 
@@ -35,6 +46,8 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  journal_commit ();
+  cache_flush ();
   free_map_close ();
 }
 
@@ -45,17 +58,17 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 0, true);
 }
 
 /* Opens the file with the given NAME.
@@ -66,11 +79,12 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, part, &inode);
   dir_close (dir);
 
   return file_open (inode);
@@ -78,26 +92,210 @@ filesys_open (const char *name)
 
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty or is the root,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  bool success;
+
+  journal_begin (DIR_REMOVE_CREDITS);
+  success = dir != NULL && dir_remove (dir, part);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
-
+
+/* Makes the directory named NAME the running thread's working
+   directory.
+   Returns true if successful, false on failure.
+   Fails if NAME is not a directory,
+   or if an internal memory allocation fails. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, part, &inode);
+  dir_close (dir);
+
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
+/* Creates a file or, if IS_DIR is true, a directory, named PATH
+   with the given INITIAL_SIZE.  The new inode is placed near its
+   directory's.  Returns true if successful, false otherwise. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir = resolve (path, name);
+  bool success;
+
+  /* A full disk may only be short of sectors that the journal
+     holds back.  If so, try again once they are free. */
+  success = (dir != NULL
+             && (add_file (dir, name, initial_size, is_dir)
+                 || (journal_reclaim ()
+                     && add_file (dir, name, initial_size, is_dir))));
+  dir_close (dir);
+
+  return success;
+}
+
+/* Creates a file or directory as for create() and adds it to DIR
+   under NAME.  Returns true if successful, false otherwise. */
+static bool
+add_file (struct dir *dir, const char *name, off_t initial_size,
+          bool is_dir)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir_get_inode (dir));
+  block_sector_t inode_sector = 0;
+  bool created = false;
+  bool success;
+
+  /* Allocating the inode, writing it, and adding it to DIR form
+     one operation, so that a crash cannot separate them.  The
+     new inode and, for a directory, its first sector are two
+     more sectors than DIR adds. */
+  journal_begin (DIR_ADD_CREDITS + 2);
+  success = (free_map_allocate (1, dir_sector, &inode_sector)
+             && (created = (is_dir
+                            ? dir_create (inode_sector, 16, dir_sector)
+                            : inode_create (inode_sector, initial_size,
+                                            false)))
+             && dir_add (dir, name, inode_sector));
+  if (!success && inode_sector != 0) 
+    {
+      /* Removing a created inode also releases the data sectors
+         it got. */
+      struct inode *inode = created ? inode_open (inode_sector) : NULL;
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+        }
+      else
+        free_map_release (inode_sector, 1);
+    }
+  journal_end ();
+
+  return success;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory that PATH names the last component of,
+   copies that component into NAME, and returns the directory.
+   A relative PATH starts from the running thread's working
+   directory.  A PATH with no components, such as "/", names the
+   directory itself, as ".".
+   Returns a null pointer if PATH is empty or too long, if a
+   component other than the last is not a directory, or if
+   memory allocation fails. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path == '/' || cwd == NULL ? dir_open_root () : dir_reopen (cwd);
+  if (dir == NULL)
+    return NULL;
+
+  result = get_next_part (name, &path);
+  if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (result > 0 && (result = get_next_part (next, &path)) > 0)
+    {
+      struct inode *inode;
+
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      if (inode == NULL || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return NULL;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_create ();
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
+
+  /* The journal only covers changes made once it is open, so put
+     the new file system on disk now. */
+  cache_flush ();
   printf ("done.\n");
 }
@@ -1,85 +1,506 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <list.h>
+#include <rbtree.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The bitmap, one bit per sector, is what is kept on disk.  To
+   avoid scanning it, the free sectors are also kept in memory as
+   extents, that is, runs of free sectors, in a red-black tree
+   ordered by starting sector, so that the extent containing a
+   sector and the extents on either side of a run of sectors are
+   found in O(lg n) time.  Each extent is also in one of BIN_CNT
+   bins by size: bin I holds the extents of 2**I to 2**(I+1) - 1
+   sectors, and the last bin holds all larger ones.
+
+   An allocation takes the sectors starting at its goal sector if
+   they are free, so that a file written in order is laid out in
+   order.  Otherwise it takes the smallest extent big enough,
+   breaking ties by closeness to the goal.  After each change,
+   only the part of the bitmap that changed is written to the
+   free map file.
+
+   Sectors released while the journal is open are cleared in
+   the bitmap at once, but are held back from the extents until
+   the journal says with free_map_reuse() that they are safe to
+   reuse.  Until the transaction that released them commits, a
+   crash would leave them in use.  A sector that held metadata in
+   a transaction still in the journal must also wait for the
+   journal's next checkpoint, because until then a replay after a
+   crash would write the old metadata to it.  If an allocation
+   fails meanwhile, free_map_starved() says so, and the journal
+   makes them available at once with a commit and a checkpoint.
+
+   free_map_lock protects the bitmap and the extents, and is
+   held while the free map file is written, so that the bitmap
+   on disk changes in the same order as in memory. */
+
+/* Number of size bins. */
+#define BIN_CNT 16
+
+/* A run of free sectors. */
+struct extent
+  {
+    struct rb_elem start_elem;      /* Element in extents. */
+    struct list_elem bin_elem;      /* Element in a bin. */
+    block_sector_t start;           /* First sector. */
+    size_t cnt;                     /* Number of sectors. */
+  };
+
+/* Sectors held back for a journal transaction. */
+struct pending
+  {
+    struct list_elem elem;          /* In pending or journaled. */
+    block_sector_t start;           /* First sector. */
+    size_t cnt;                     /* Number of sectors. */
+    unsigned txn;                   /* Transaction that released them. */
+  };
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct rb_tree extents;       /* Free extents, by start. */
+static struct list bins[BIN_CNT];    /* Free extents, by size. */
+static struct list pending;          /* Held until commit, by txn. */
+static struct list journaled;        /* Held until checkpoint, by txn. */
+static bool starved;                 /* Allocation failed while held? */
+static struct lock free_map_lock;    /* Protects the above. */
+
+static rb_less_func extent_less;
+static void build_extents (void);
+static struct extent *find_goal (block_sector_t goal, size_t cnt);
+static struct extent *find_best (block_sector_t goal, size_t cnt);
+static bool take_sectors (struct extent *, block_sector_t, size_t cnt);
+static void add_sectors (block_sector_t, size_t cnt);
+static bool write_sectors (block_sector_t, size_t cnt);
+static void reuse (struct list *, unsigned txn);
 
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
+  size_t i;
+
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+
+  rb_init (&extents, extent_less, NULL);
+  list_init (&pending);
+  list_init (&journaled);
+  for (i = 0; i < BIN_CNT; i++)
+    list_init (&bins[i]);
+  build_extents ();
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, as close
+   to sector GOAL as possible, and stores the first into
+   *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (size_t cnt, block_sector_t goal, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  struct extent *e;
+  block_sector_t sector;
+  bool success = false;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  sector = goal;
+  e = find_goal (goal, cnt);
+  if (e == NULL || !take_sectors (e, sector, cnt))
+    {
+      /* Taking sectors from the start of an extent never needs
+         memory, so this only fails if no extent is big enough. */
+      e = find_best (goal, cnt);
+      if (e == NULL)
+        {
+          if (!list_empty (&pending) || !list_empty (&journaled))
+            starved = true;
+          goto done;
+        }
+      sector = e->start;
+      take_sectors (e, sector, cnt);
+    }
+
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (!write_sectors (sector, cnt))
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      add_sectors (sector, cnt);
+      goto done;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  *sectorp = sector;
+  success = true;
+
+ done:
+  lock_release (&free_map_lock);
+  return success;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.  If a
+   journal transaction is running, they only become available
+   once it commits, or, if they held metadata in the journal,
+   after the journal's next checkpoint. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  unsigned txn = journal_txn ();
+  bool logged = txn != 0 && journal_logged (sector, cnt);
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  write_sectors (sector, cnt);
+  if (txn != 0)
+    {
+      /* Without memory the sectors are leaked until the extents
+         are next rebuilt, which is safe. */
+      struct pending *p = malloc (sizeof *p);
+      if (p != NULL)
+        {
+          p->start = sector;
+          p->cnt = cnt;
+          p->txn = txn;
+          list_push_back (logged ? &journaled : &pending, &p->elem);
+        }
+    }
+  else
+    add_sectors (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Makes available the sectors held back for journal
+   transactions up to COMMITTED, which are in the journal, except
+   those that held metadata in the journal, which must also wait
+   until transactions up to CHECKPOINTED are written home. */
+void
+free_map_reuse (unsigned committed, unsigned checkpointed)
+{
+  lock_acquire (&free_map_lock);
+  reuse (&pending, committed);
+  reuse (&journaled, checkpointed);
+  if (list_empty (&pending) && list_empty (&journaled))
+    starved = false;
+  lock_release (&free_map_lock);
+}
+
+/* Returns true if an allocation has failed while released
+   sectors were held back for the journal, and some still are,
+   false otherwise. */
+bool
+free_map_starved (void)
+{
+  bool result;
+
+  lock_acquire (&free_map_lock);
+  result = starved;
+  lock_release (&free_map_lock);
+  return result;
 }
 
 /* Opens the free map file and reads it from disk. */
 void
-free_map_open (void) 
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  build_extents ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file.  Later changes to the free map are
+   not written to disk. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
+  struct file *file;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The first write allocates the file's
+     sectors, which changes the bitmap as it is being written, so
+     write it again once they are all allocated.  free_map_file
+     stays null during the first write, so that the allocations
+     do not write the bitmap themselves. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
+  if (!bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  free_map_file = file;
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Writes the part of the bitmap that holds the bits for the CNT
+   sectors starting at SECTOR to the free map file, if it is
+   open.  Returns true if successful, false otherwise. */
+static bool
+write_sectors (block_sector_t sector, size_t cnt)
+{
+  return (free_map_file == NULL
+          || bitmap_write_part (free_map, free_map_file, sector, cnt));
+}
+
+/* Makes available the sectors in LIST, a list of struct pending
+   in order of transaction, held back for transactions up to
+   TXN. */
+static void
+reuse (struct list *list, unsigned txn)
+{
+  while (!list_empty (list))
+    {
+      struct pending *p = list_entry (list_front (list),
+                                      struct pending, elem);
+      if (p->txn > txn)
+        break;
+      list_pop_front (list);
+      add_sectors (p->start, p->cnt);
+      free (p);
+    }
+}
+
+/* Returns the bin for an extent of CNT sectors. */
+static size_t
+bin_of (size_t cnt)
+{
+  size_t bin = 0;
+
+  ASSERT (cnt > 0);
+  while (cnt > 1 && bin < BIN_CNT - 1)
+    {
+      cnt >>= 1;
+      bin++;
+    }
+  return bin;
+}
+
+/* Returns true if extent A starts before extent B. */
+static bool
+extent_less (const struct rb_elem *a, const struct rb_elem *b,
+             void *aux UNUSED)
+{
+  return (rb_entry (a, struct extent, start_elem)->start
+          < rb_entry (b, struct extent, start_elem)->start);
+}
+
+/* Returns the last extent that starts at or before SECTOR, or a
+   null pointer if there is none. */
+static struct extent *
+extent_before (block_sector_t sector)
+{
+  struct extent key;
+  struct rb_elem *elem;
+
+  key.start = sector;
+  elem = rb_floor (&extents, &key.start_elem);
+  return elem != NULL ? rb_entry (elem, struct extent, start_elem) : NULL;
+}
+
+/* Sets the size of extent E to CNT sectors, moving it to the
+   right bin.  If CNT is 0, removes E and frees it instead.
+   Callers may also move E's start, as long as it stays between
+   the extents on either side, without reinserting it. */
+static void
+resize_extent (struct extent *e, size_t cnt)
+{
+  list_remove (&e->bin_elem);
+  if (cnt == 0)
+    {
+      rb_remove (&extents, &e->start_elem);
+      free (e);
+      return;
+    }
+  e->cnt = cnt;
+  list_push_front (&bins[bin_of (cnt)], &e->bin_elem);
+}
+
+/* Creates an extent of CNT sectors at START and inserts it into
+   the extents and into its bin.  Returns the new extent, or a
+   null pointer if memory is not available. */
+static struct extent *
+new_extent (block_sector_t start, size_t cnt)
+{
+  struct extent *e = malloc (sizeof *e);
+
+  if (e != NULL)
+    {
+      e->start = start;
+      e->cnt = cnt;
+      rb_insert (&extents, &e->start_elem);
+      list_push_front (&bins[bin_of (cnt)], &e->bin_elem);
+    }
+  return e;
+}
+
+/* Discards all the extents and rebuilds them from the bitmap.
+   If memory runs out, the free sectors without an extent cannot
+   be allocated until the extents are next rebuilt. */
+static void
+build_extents (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = 0;
+
+  while (!rb_empty (&extents))
+    {
+      struct rb_elem *e = rb_first (&extents);
+      resize_extent (rb_entry (e, struct extent, start_elem), 0);
+    }
+
+  for (;;)
+    {
+      size_t end;
+
+      start = bitmap_scan (free_map, start, 1, false);
+      if (start == BITMAP_ERROR)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = size;
+      new_extent (start, end - start);
+      start = end;
+    }
+}
+
+/* Returns the free extent that contains sector GOAL, if CNT free
+   sectors start at GOAL.  Otherwise, returns a null pointer. */
+static struct extent *
+find_goal (block_sector_t goal, size_t cnt)
+{
+  struct extent *e;
+
+  /* A sector in use is in no extent.  A free sector may still be
+     held back, and so also be in no extent. */
+  if (goal >= bitmap_size (free_map) || bitmap_test (free_map, goal))
+    return NULL;
+  e = extent_before (goal);
+  if (e == NULL || goal - e->start >= e->cnt)
+    return NULL;
+  return e->start + e->cnt - goal >= cnt ? e : NULL;
+}
+
+/* Returns the smallest free extent of at least CNT sectors,
+   preferring the one closest to sector GOAL among several of the
+   same size, or a null pointer if there is no such extent. */
+static struct extent *
+find_best (block_sector_t goal, size_t cnt)
+{
+  size_t bin;
+
+  /* Every extent in a bin is smaller than every extent in the
+     bins after it, so the first bin with a fit has the best. */
+  for (bin = bin_of (cnt); bin < BIN_CNT; bin++)
+    {
+      struct extent *best = NULL;
+      size_t best_dist = 0;
+      struct list_elem *elem;
+
+      for (elem = list_begin (&bins[bin]); elem != list_end (&bins[bin]);
+           elem = list_next (elem))
+        {
+          struct extent *e = list_entry (elem, struct extent, bin_elem);
+          size_t dist = e->start > goal ? e->start - goal : goal - e->start;
+
+          if (e->cnt < cnt)
+            continue;
+          if (best == NULL || e->cnt < best->cnt
+              || (e->cnt == best->cnt && dist < best_dist))
+            {
+              best = e;
+              best_dist = dist;
+            }
+        }
+      if (best != NULL)
+        return best;
+    }
+  return NULL;
+}
+
+/* Removes the CNT sectors starting at SECTOR, which must lie
+   within extent E, from E.  Returns true if successful, false if
+   E had to be split in two and memory was not available. */
+static bool
+take_sectors (struct extent *e, block_sector_t sector, size_t cnt)
+{
+  block_sector_t end = e->start + e->cnt;
+
+  ASSERT (sector >= e->start && sector + cnt <= end);
+
+  if (sector == e->start)
+    {
+      e->start += cnt;
+      resize_extent (e, e->cnt - cnt);
+    }
+  else if (sector + cnt == end)
+    resize_extent (e, e->cnt - cnt);
+  else
+    {
+      if (new_extent (sector + cnt, end - (sector + cnt)) == NULL)
+        return false;
+      resize_extent (e, sector - e->start);
+    }
+  return true;
+}
+
+/* Adds the CNT sectors starting at SECTOR to the free extents,
+   merging them with the extents next to them.  If memory runs
+   out, the sectors stay free in the bitmap but cannot be
+   allocated until the extents are next rebuilt. */
+static void
+add_sectors (block_sector_t sector, size_t cnt)
+{
+  struct extent *prev, *next;
+  struct rb_elem *elem;
+
+  /* SECTOR is in no extent, so PREV, if any, starts before it and
+     the extent after PREV starts after it. */
+  prev = extent_before (sector);
+  elem = prev != NULL ? rb_next (&prev->start_elem) : rb_first (&extents);
+  next = elem != NULL ? rb_entry (elem, struct extent, start_elem) : NULL;
+
+  if (prev != NULL && prev->start + prev->cnt == sector)
+    {
+      if (next != NULL && sector + cnt == next->start)
+        {
+          cnt += next->cnt;
+          resize_extent (next, 0);
+        }
+      resize_extent (prev, prev->cnt + cnt);
+    }
+  else if (next != NULL && sector + cnt == next->start)
+    {
+      next->start = sector;
+      resize_extent (next, next->cnt + cnt);
+    }
+  else
+    new_extent (sector, cnt);
+}
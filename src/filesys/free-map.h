@@ -11,7 +11,9 @@ void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
-bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate (size_t, block_sector_t goal, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_reuse (unsigned committed, unsigned checkpointed);
+bool free_map_starved (void);
 
 #endif /* filesys/free-map.h */
@@ -1,23 +1,44 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers held directly in an inode and in
+   an indirect block. */
+#define DIRECT_CNT 123
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest number of data sectors an inode can index. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + INDIRECT_CNT * INDIRECT_CNT)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The first DIRECT_CNT data sectors are listed in the inode
+   itself, the next INDIRECT_CNT in the indirect block, and the
+   rest in the indirect blocks listed in the doubly indirect
+   block.  A pointer of 0 means that the sector, or the whole
+   range an indirect block would cover, has never been written:
+   it takes no space on disk and reads as zeros.  (Sector 0
+   holds the free map's inode, so it is never a data sector.) */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* 1 for a directory, 0 for a file. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +49,206 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   Each inode has three locks.  RWLOCK is held for reading while
+   the inode's data is read and for writing while it is written,
+   because writing may extend the inode and allocate sectors, so
+   that readers of one inode proceed together and nothing waits
+   for I/O on an unrelated inode.  inode_open() also holds it for
+   writing while it reads the inode from disk.  LOCK protects the state that
+   is neither data nor part of open_inodes.  DIR_LOCK is only
+   used by directory.c, to make each operation on a directory
+   atomic.  A thread holding a directory's DIR_LOCK may acquire
+   the locks of the directory's entries and any of the
+   directory's other locks, but not the other way around. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    struct lock lock;                   /* Protects the two members below. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Protects the two members below. */
+    block_sector_t goal;                /* Where to try to allocate next. */
     struct inode_disk data;             /* Inode content. */
+    struct lock dir_lock;               /* Directory lock. */
   };
 
+/* Returns true if INODE's data is metadata, which goes through
+   the journal: a directory's entries or the free map.  Inodes
+   and indirect blocks are always metadata. */
+static bool
+holds_metadata (const struct inode *inode)
+{
+  return inode->data.is_dir || inode->sector == FREE_MAP_SECTOR;
+}
+
+/* Returns the number of metadata sectors, apart from the free
+   map's, that writing SIZE bytes at OFFSET in INODE may change:
+   the inode, its indirect and doubly indirect blocks, the blocks
+   below the doubly indirect block that cover the sectors
+   written, and, if INODE holds metadata, those sectors. */
+static size_t
+write_credits (const struct inode *inode, off_t size, off_t offset)
+{
+  size_t cnt = DIV_ROUND_UP (offset % BLOCK_SECTOR_SIZE + size,
+                             BLOCK_SECTOR_SIZE);
+  size_t credits = 3 + DIV_ROUND_UP (cnt, INDIRECT_CNT) + 1;
+
+  if (holds_metadata (inode))
+    credits += cnt;
+  return credits;
+}
+
+/* Allocates a sector filled with zeros for INODE and stores its
+   number in *SECTORP.  Tries the sector after the one INODE got
+   last, so that a file written in order is laid out in order.
+   META says whether the sector will hold metadata.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_zeroed (struct inode *inode, bool meta, block_sector_t *sectorp)
+{
+  static const char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate (1, inode->goal, sectorp))
+    return false;
+  inode->goal = *sectorp + 1;
+  if (meta)
+    cache_write_meta (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  else
+    cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the sector that *SLOTP, a pointer in INODE's on-disk
+   inode, refers to.  If the pointer is 0 and CREATE is true,
+   allocates a zeroed sector for it first, which holds metadata
+   if META is true.  Returns 0 if there is no such sector. */
+static block_sector_t
+inode_slot (struct inode *inode, block_sector_t *slotp, bool create,
+            bool meta)
+{
+  if (*slotp == 0 && create && allocate_zeroed (inode, meta, slotp))
+    cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  return *slotp;
+}
+
+/* Returns the sector that pointer IDX in INODE's indirect block
+   INDIRECT refers to, like inode_slot().  Returns 0 if INDIRECT
+   is 0. */
+static block_sector_t
+indirect_slot (struct inode *inode, block_sector_t indirect, size_t idx,
+               bool create, bool meta)
+{
+  block_sector_t sector;
+
+  if (indirect == 0)
+    return 0;
+  cache_read (indirect, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && create && allocate_zeroed (inode, meta, &sector))
+    cache_write_meta (indirect, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE.  If that part of INODE has no sector yet and
+   CREATE is true, allocates one, along with any indirect blocks
+   needed to reach it.
+   Returns 0 if INODE has no sector for POS, either because it
+   was never written or because allocation failed, and -1 if POS
+   is past the largest possible inode. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool create) 
 {
+  size_t idx;
+  bool meta;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  ASSERT (pos >= 0);
+
+  meta = holds_metadata (inode);
+  idx = pos / BLOCK_SECTOR_SIZE;
+  if (idx < DIRECT_CNT)
+    return inode_slot (inode, &inode->data.direct[idx], create, meta);
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT)
+    return indirect_slot (inode,
+                          inode_slot (inode, &inode->data.indirect, create,
+                                      true),
+                          idx, create, meta);
+  idx -= INDIRECT_CNT;
+
+  if (idx < INDIRECT_CNT * INDIRECT_CNT)
+    {
+      block_sector_t doubly;
+
+      doubly = inode_slot (inode, &inode->data.doubly_indirect, create,
+                           true);
+      return indirect_slot (inode,
+                            indirect_slot (inode, doubly,
+                                           idx / INDIRECT_CNT, create, true),
+                            idx % INDIRECT_CNT, create, meta);
+    }
+  return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Releases SECTOR and, if LEVEL is greater than 0, the sectors
+   it points to, recursing through LEVEL levels of indirect
+   blocks.  Does nothing if SECTOR is 0. */
+static void
+release_sectors (block_sector_t sector, int level)
+{
+  if (sector == 0)
+    return;
+
+  if (level > 0)
+    {
+      block_sector_t *slots = malloc (BLOCK_SECTOR_SIZE);
+      size_t i;
+
+      /* Without memory the pointed-to sectors are leaked, not
+         corrupted. */
+      if (slots != NULL)
+        {
+          cache_read (sector, slots, 0, BLOCK_SECTOR_SIZE);
+          for (i = 0; i < INDIRECT_CNT; i++)
+            release_sectors (slots[i], level - 1);
+          free (slots);
+        }
+    }
+  free_map_release (sector, 1);
+}
+
+/* Open inodes, by sector, so that opening a single inode twice
+   returns the same `struct inode'.  open_inodes_lock protects
+   the table and each inode's open_cnt. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static struct inode *find_open (block_sector_t);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table allocation failed");
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true and an
+   ordinary file otherwise.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,25 +259,18 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (bytes_to_sectors (length) > MAX_SECTORS)
+    return false;
+
+  /* No data sectors are allocated until they are written. */
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->is_dir = is_dir;
+      cache_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true; 
       free (disk_inode);
     }
   return success;
@@ -111,33 +282,48 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open.  If it is, wait
+     until the thread that opened it has read it. */
+  lock_acquire (&open_inodes_lock);
+  inode = find_open (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      rwlock_acquire_read (&inode->rwlock);
+      rwlock_release_read (&inode->rwlock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize and insert the inode before reading it, so that
+     nobody can open, change and close it meanwhile and leave
+     this thread with a stale copy.  Its rwlock, held for
+     writing until it has been read, keeps other openers out
+     without holding open_inodes_lock during the read. */
   inode->sector = sector;
   inode->open_cnt = 1;
+  lock_init (&inode->lock);
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rwlock);
+  rwlock_acquire_write (&inode->rwlock);
+  inode->goal = sector + 1;
+  lock_init (&inode->dir_lock);
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->rwlock);
   return inode;
 }
 
@@ -146,7 +332,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,22 +353,33 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          size_t i;
+
+          journal_begin (0);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          for (i = 0; i < DIRECT_CNT; i++)
+            release_sectors (inode->data.direct[i], 0);
+          release_sectors (inode->data.indirect, 1);
+          release_sectors (inode->data.doubly_indirect, 2);
+          journal_end ();
         }
 
       free (inode); 
@@ -191,24 +392,39 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
+}
+
+/* Returns true if INODE has been removed, false otherwise. */
+bool
+inode_is_removed (struct inode *inode)
+{
+  bool removed;
+
+  lock_acquire (&inode->lock);
+  removed = inode->removed;
+  lock_release (&inode->lock);
+  return removed;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Parts of INODE that were never written read as zeros. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rwlock);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
@@ -220,110 +436,135 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      sector_idx = byte_to_sector (inode, offset, false);
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   as one file system operation.  Returns the number of bytes
+   actually written, which may be less than SIZE if the disk
+   fills up or the inode reaches its maximum size. */
+static off_t
+write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+          off_t offset)
 {
-  const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
-
-  if (inode->deny_write_cnt)
-    return 0;
+  bool meta;
 
+  /* Begin before taking the rwlock, which an operation under way
+     in the running transaction may be waiting for. */
+  journal_begin (write_credits (inode, size, offset));
+  rwlock_acquire_write (&inode->rwlock);
+  meta = holds_metadata (inode);
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, true);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0 || sector_idx == (block_sector_t) -1)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      if (meta)
+        cache_write_meta (sector_idx, buffer + bytes_written,
+                          sector_ofs, chunk_size);
+      else
+        cache_write (sector_idx, buffer + bytes_written,
+                     sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  /* Extend the inode to cover what was written. */
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  rwlock_release_write (&inode->rwlock);
+  journal_end ();
+
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or the inode reaches its
+   maximum size.  A write past end of file extends the inode,
+   allocating sectors only for the bytes written. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written;
+  bool denied;
+
+  lock_acquire (&inode->lock);
+  denied = inode->deny_write_cnt > 0;
+  lock_release (&inode->lock);
+  if (denied)
+    return 0;
+
+  /* A full disk may only be short of sectors that the journal
+     holds back.  If so, try the rest again once they are free. */
+  bytes_written = write_at (inode, buffer, size, offset);
+  if (bytes_written < size && journal_reclaim ())
+    bytes_written += write_at (inode, buffer + bytes_written,
+                               size - bytes_written,
+                               offset + bytes_written);
   return bytes_written;
 }
 
+/* Starts reading the sectors that hold the SIZE bytes of INODE
+   at OFFSET into the buffer cache in the background.  Ignores
+   the part of the range past the end of INODE and sectors never
+   written. */
+void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset, false);
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+  rwlock_release_read (&inode->rwlock);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +573,69 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  Without
+   holding INODE's rwlock, the result may be out of date as soon
+   as it is returned. */
 off_t
 inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Acquires INODE's directory lock. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
+
+/* Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns the open inode for SECTOR, or a null pointer if it is
+   not open.  The caller must hold open_inodes_lock. */
+static struct inode *
+find_open (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
@@ -0,0 +1,577 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Metadata journal.  Every change to metadata (inodes, indirect
+   blocks, directory entries, and the free map) belongs to a
+   transaction, and reaches its home sector only after the whole
+   transaction has been written to the journal, a region of
+   JOURNAL_SECTORS sectors starting at JOURNAL_SECTOR.  After a
+   crash, journal_open() writes the transactions found in the
+   journal to their home sectors, so that each one either
+   happened completely or not at all.  Ordinary file data does
+   not go through the journal.
+
+   A file system operation runs between journal_begin() and
+   journal_end(), and becomes part of the running transaction.
+   Many operations share one transaction: it is committed every
+   JOURNAL_INTERVAL ticks, or when it is too full to take another
+   operation.  To commit, journal_commit() keeps new operations
+   from starting, waits for those under way to end, copies the
+   sectors they changed out of the buffer cache, and lets new
+   operations start again in a new transaction while it writes
+   the copies to the journal sequentially.  Only then does the
+   buffer cache write the sectors home.
+
+   Until then, the changed sectors cannot leave the buffer cache,
+   so the sectors of the running and committing transactions
+   together are kept below txn_capacity, which leaves room in the
+   cache for everything else.  An operation never commits, so
+   each one reserves in journal_begin() as many sectors as it may
+   change: its caller's count, for the operation's worst case,
+   plus every sector of the free map file.  journal_begin() waits
+   until the reservation fits below txn_capacity, which it can do
+   because its caller holds no locks yet.  An operation that only
+   sometimes needs more, such as a bucket split, asks for it with
+   journal_extend(), which does not wait, and goes without if
+   there is no room.
+
+   The journal starts with a header, which holds the sequence
+   number of the first transaction in the journal.  Each
+   transaction is written as a descriptor, listing the home
+   sectors of up to DESC_CNT sectors, followed by those sectors,
+   repeated as needed, followed by a commit block.  A
+   transaction without a commit block, or with blocks whose
+   sequence numbers do not match, was interrupted, and ends the
+   journal.
+
+   When a transaction does not fit in the rest of the journal,
+   the journal is checkpointed: the transactions in it are
+   written home, the same way as after a crash, and the journal
+   starts over.  Until then, a replay could write old metadata to
+   any sector in the journal, so the free map holds back a
+   released sector that is in the journal, or in the running or
+   committing transaction, until the next checkpoint.  Other
+   released sectors are only held back until the transaction
+   that released them commits.  If an allocation fails for want
+   of them, journal_reclaim() commits and checkpoints at once.
+
+   journal_lock protects the running transaction, the operation
+   count, the reservations, and the set of sectors in the
+   journal.  Only one thread commits or checkpoints at a time,
+   and it alone uses the commit buffers. */
+
+/* Ticks between commits. */
+#define JOURNAL_INTERVAL TIMER_FREQ
+
+/* Magic numbers for the blocks in the journal. */
+#define HEADER_MAGIC 0x4a484452         /* "JHDR". */
+#define DESC_MAGIC 0x4a444553           /* "JDES". */
+#define COMMIT_MAGIC 0x4a434d54         /* "JCMT". */
+
+/* Number of home sectors listed in a descriptor. */
+#define DESC_CNT ((BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t)) \
+                  / sizeof (block_sector_t))
+
+/* Largest transaction that fits in the journal, with its
+   descriptors and commit block, after the header. */
+#define MAX_TXN_SECTORS (JOURNAL_SECTORS - 5)
+
+/* A header, descriptor, or commit block.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_block
+  {
+    uint32_t magic;                     /* One of the magic numbers. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[DESC_CNT];   /* Home sectors, in a descriptor. */
+  };
+
+static bool enabled;                    /* Journaling changes? */
+static size_t free_map_credits;         /* Sectors in the free map file. */
+static size_t txn_capacity;             /* Most uncommitted sectors. */
+
+/* Running transaction. */
+static unsigned running_txn;            /* Sequence number. */
+static block_sector_t *sectors;         /* Sectors changed. */
+static size_t sector_cnt;               /* Number of sectors changed. */
+static struct bitmap *logged;           /* Sectors changed, one bit each. */
+static struct bitmap *journaled;        /* Sectors in the journal or
+                                           being committed. */
+static int active_cnt;                  /* Operations under way. */
+static size_t reserved;                 /* Their unused reservations. */
+static bool closing;                    /* Operations kept from starting? */
+static bool committing;                 /* Commit under way? */
+static size_t committing_cnt;           /* Sectors being committed. */
+static struct lock journal_lock;        /* Protects the above. */
+static struct condition begin_cond;     /* Signaled when CLOSING clears. */
+static struct condition room_cond;      /* Signaled when room is freed. */
+static struct condition drain_cond;     /* Signaled when ACTIVE_CNT is 0. */
+static struct condition commit_cond;    /* Signaled when COMMITTING clears. */
+
+/* Used only by the committing thread. */
+static unsigned first_txn;              /* First transaction in journal. */
+static size_t head;                     /* Next free journal sector. */
+static block_sector_t *commit_sectors;  /* Sectors being committed. */
+static uint8_t *commit_data;            /* Their contents. */
+static struct journal_block block;      /* Journal block buffer. */
+static uint8_t sector_buf[BLOCK_SECTOR_SIZE];  /* Sector buffer. */
+
+static thread_func journal_thread;
+static unsigned replay (unsigned seq);
+static void write_txn (unsigned seq, size_t cnt);
+static void checkpoint (unsigned seq, size_t cnt);
+static void write_header (unsigned seq);
+
+/* Creates an empty journal.  Must be called while formatting the
+   file system, before journal_open(). */
+void
+journal_create (void)
+{
+  size_t i;
+
+  /* Clear out any journal left by an earlier file system, whose
+     transactions could otherwise be taken for this one's. */
+  memset (&block, 0, sizeof block);
+  for (i = 1; i < JOURNAL_SECTORS; i++)
+    block_write (fs_device, JOURNAL_SECTOR + i, &block);
+  write_header (1);
+}
+
+/* Finishes any transactions interrupted by a crash, by writing
+   those that were committed to their home sectors, and starts
+   journaling changes to metadata.  Must be called before
+   anything reads metadata through the buffer cache. */
+void
+journal_open (void)
+{
+  size_t page_cnt;
+
+  ASSERT (sizeof block == BLOCK_SECTOR_SIZE);
+
+  block_read (fs_device, JOURNAL_SECTOR, &block);
+  if (block.magic != HEADER_MAGIC)
+    PANIC ("file system has no journal--reformat with -f");
+  running_txn = replay (block.seq);
+  first_txn = running_txn;
+  head = 1;
+  write_header (running_txn);
+
+  txn_capacity = cache_sectors * 3 / 4;
+  if (txn_capacity > MAX_TXN_SECTORS)
+    txn_capacity = MAX_TXN_SECTORS;
+  free_map_credits = DIV_ROUND_UP (block_size (fs_device),
+                                  BLOCK_SECTOR_SIZE * 8);
+  page_cnt = DIV_ROUND_UP (txn_capacity * BLOCK_SECTOR_SIZE, PGSIZE);
+  sectors = malloc (txn_capacity * sizeof *sectors);
+  commit_sectors = malloc (txn_capacity * sizeof *commit_sectors);
+  commit_data = palloc_get_multiple (0, page_cnt);
+  logged = bitmap_create (block_size (fs_device));
+  journaled = bitmap_create (block_size (fs_device));
+  if (sectors == NULL || commit_sectors == NULL || commit_data == NULL
+      || logged == NULL || journaled == NULL)
+    PANIC ("journal allocation failed");
+
+  sector_cnt = 0;
+  active_cnt = 0;
+  reserved = 0;
+  closing = committing = false;
+  committing_cnt = 0;
+  lock_init (&journal_lock);
+  cond_init (&begin_cond);
+  cond_init (&room_cond);
+  cond_init (&drain_cond);
+  cond_init (&commit_cond);
+  enabled = true;
+
+  thread_create ("journal", PRI_DEFAULT, journal_thread, NULL);
+}
+
+/* Starts a file system operation, which becomes part of the
+   running transaction and may change up to CREDITS metadata
+   sectors besides the free map's.  Operations nest, and only the
+   outermost one counts, so the caller of the outermost one must
+   not hold any lock that an operation under way might need and
+   must pass credits for all of the nested ones. */
+void
+journal_begin (size_t credits)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled || t->journal_depth++ > 0)
+    return;
+
+  credits += free_map_credits;
+  ASSERT (credits <= txn_capacity);
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (closing)
+        cond_wait (&begin_cond, &journal_lock);
+      else if (sector_cnt + committing_cnt + reserved + credits
+               <= txn_capacity)
+        break;
+      else if (active_cnt > 0 || committing)
+        {
+          /* Operations ending or a commit finishing may free
+             enough room. */
+          cond_wait (&room_cond, &journal_lock);
+        }
+      else
+        {
+          /* The running transaction is full.  Commit it. */
+          lock_release (&journal_lock);
+          journal_commit ();
+          lock_acquire (&journal_lock);
+        }
+    }
+  active_cnt++;
+  t->journal_credits = credits;
+  reserved += credits;
+  lock_release (&journal_lock);
+}
+
+/* Adds CREDITS sectors to the running operation's reservation,
+   if there is room for them.  Returns true if successful, false
+   if the operation must do without them.  Never waits, so it may
+   be called with locks held. */
+bool
+journal_extend (size_t credits)
+{
+  struct thread *t = thread_current ();
+  bool success;
+
+  if (!enabled)
+    return true;
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  success = sector_cnt + committing_cnt + reserved + credits
+            <= txn_capacity;
+  if (success)
+    {
+      t->journal_credits += credits;
+      reserved += credits;
+    }
+  lock_release (&journal_lock);
+  return success;
+}
+
+/* Ends a file system operation started with journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled)
+    return;
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  /* Return the unused reservation. */
+  lock_acquire (&journal_lock);
+  reserved -= t->journal_credits;
+  t->journal_credits = 0;
+  if (--active_cnt == 0)
+    cond_signal (&drain_cond, &journal_lock);
+  cond_broadcast (&room_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR, which the running operation is about to change,
+   to the running transaction, and returns the transaction's
+   sequence number.  Returns 0 while the journal is not open, as
+   when formatting, because then changes need no journal. */
+unsigned
+journal_add (block_sector_t sector)
+{
+  struct thread *t = thread_current ();
+  unsigned txn;
+
+  if (!enabled)
+    return 0;
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  if (!bitmap_test (logged, sector))
+    {
+      /* The reservation is for the worst case. */
+      ASSERT (t->journal_credits > 0);
+      t->journal_credits--;
+      reserved--;
+      bitmap_mark (logged, sector);
+      sectors[sector_cnt++] = sector;
+    }
+  txn = running_txn;
+  lock_release (&journal_lock);
+  return txn;
+}
+
+/* Returns true if any of the CNT sectors starting at SECTOR is
+   in the journal or in the running or committing transaction,
+   false otherwise. */
+bool
+journal_logged (block_sector_t sector, size_t cnt)
+{
+  bool found;
+
+  lock_acquire (&journal_lock);
+  found = (bitmap_contains (logged, sector, cnt, true)
+           || bitmap_contains (journaled, sector, cnt, true));
+  lock_release (&journal_lock);
+  return found;
+}
+
+/* Returns the running transaction's sequence number, or 0 if
+   the journal is not open.  Must be called between
+   journal_begin() and journal_end(). */
+unsigned
+journal_txn (void)
+{
+  return enabled ? running_txn : 0;
+}
+
+/* Commits the running transaction, if it changed anything, and
+   waits until it is in the journal. */
+void
+journal_commit (void)
+{
+  unsigned txn;
+  size_t cnt, i;
+
+  if (!enabled)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_cond, &journal_lock);
+  if (sector_cnt == 0)
+    {
+      lock_release (&journal_lock);
+      return;
+    }
+
+  /* Keep new operations from starting and wait for those under
+     way to end, so that the transaction is complete. */
+  committing = closing = true;
+  while (active_cnt > 0)
+    cond_wait (&drain_cond, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* Copy the changed sectors.  Nothing can change them, or the
+     running transaction, until operations start again. */
+  txn = running_txn;
+  cnt = sector_cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      commit_sectors[i] = sectors[i];
+      cache_read (sectors[i], commit_data + i * BLOCK_SECTOR_SIZE,
+                  0, BLOCK_SECTOR_SIZE);
+      bitmap_reset (logged, sectors[i]);
+      bitmap_mark (journaled, sectors[i]);
+    }
+
+  lock_acquire (&journal_lock);
+  running_txn++;
+  sector_cnt = 0;
+  committing_cnt = cnt;
+  closing = false;
+  cond_broadcast (&begin_cond, &journal_lock);
+  lock_release (&journal_lock);
+
+  write_txn (txn, cnt);
+  cache_commit (txn);
+  free_map_reuse (txn, first_txn - 1);
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  committing_cnt = 0;
+  cond_broadcast (&commit_cond, &journal_lock);
+  cond_broadcast (&room_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* If an allocation has failed while the free map held back
+   released sectors, makes them available by committing the
+   running transaction and checkpointing the journal, so that the
+   caller can retry.  Returns true if successful, false if there
+   was no such failure or if the caller is inside a file system
+   operation, which a commit would wait for. */
+bool
+journal_reclaim (void)
+{
+  unsigned seq;
+
+  if (!enabled || thread_current ()->journal_depth > 0
+      || !free_map_starved ())
+    return false;
+  journal_commit ();
+
+  /* Every transaction before the running one is in the
+     journal, unless another commit started meanwhile, which
+     taking over the commit buffers waits for. */
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_cond, &journal_lock);
+  committing = true;
+  seq = running_txn;
+  lock_release (&journal_lock);
+
+  checkpoint (seq, 0);
+  free_map_reuse (seq - 1, seq - 1);
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&commit_cond, &journal_lock);
+  cond_broadcast (&room_cond, &journal_lock);
+  lock_release (&journal_lock);
+  return true;
+}
+
+/* Commits the running transaction every JOURNAL_INTERVAL
+   ticks. */
+static void
+journal_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (JOURNAL_INTERVAL);
+      journal_commit ();
+    }
+}
+
+/* Writes the transactions in the journal to their home sectors,
+   starting from the one numbered SEQ at the start of the
+   journal, and returns the sequence number of the transaction
+   that would follow the last one written. */
+static unsigned
+replay (unsigned seq)
+{
+  size_t pos = 1;
+
+  for (;;)
+    {
+      size_t start = pos;
+      size_t cnt = 0;
+
+      /* Find the commit block, to make sure the transaction is
+         complete. */
+      for (;;)
+        {
+          if (pos >= JOURNAL_SECTORS)
+            return seq;
+          block_read (fs_device, JOURNAL_SECTOR + pos, &block);
+          if (block.seq != seq)
+            return seq;
+          if (block.magic == COMMIT_MAGIC)
+            break;
+          if (block.magic != DESC_MAGIC || block.cnt > DESC_CNT)
+            return seq;
+          pos += 1 + block.cnt;
+          cnt += block.cnt;
+        }
+      if (block.cnt != cnt)
+        return seq;
+
+      /* Write it home. */
+      while (start < pos)
+        {
+          size_t i;
+
+          block_read (fs_device, JOURNAL_SECTOR + start, &block);
+          for (i = 0; i < block.cnt; i++)
+            {
+              block_read (fs_device, JOURNAL_SECTOR + start + 1 + i,
+                          sector_buf);
+              block_write (fs_device, block.sectors[i], sector_buf);
+            }
+          start += 1 + block.cnt;
+        }
+      pos++;
+      seq++;
+    }
+}
+
+/* Writes the CNT sectors in commit_sectors and commit_data to
+   the journal as transaction SEQ, checkpointing first if they
+   do not fit. */
+static void
+write_txn (unsigned seq, size_t cnt)
+{
+  size_t need = DIV_ROUND_UP (cnt, DESC_CNT) + cnt + 1;
+  size_t i, j;
+
+  ASSERT (need < JOURNAL_SECTORS);
+
+  if (head + need > JOURNAL_SECTORS)
+    checkpoint (seq, cnt);
+
+  for (i = 0; i < cnt; i += DESC_CNT)
+    {
+      size_t n = cnt - i < DESC_CNT ? cnt - i : DESC_CNT;
+
+      memset (&block, 0, sizeof block);
+      block.magic = DESC_MAGIC;
+      block.seq = seq;
+      block.cnt = n;
+      memcpy (block.sectors, commit_sectors + i, n * sizeof *block.sectors);
+      block_write (fs_device, JOURNAL_SECTOR + head++, &block);
+      for (j = 0; j < n; j++)
+        block_write (fs_device, JOURNAL_SECTOR + head++,
+                     commit_data + (i + j) * BLOCK_SECTOR_SIZE);
+    }
+
+  /* Only the commit block makes the transaction count. */
+  memset (&block, 0, sizeof block);
+  block.magic = COMMIT_MAGIC;
+  block.seq = seq;
+  block.cnt = cnt;
+  block_write (fs_device, JOURNAL_SECTOR + head++, &block);
+}
+
+/* Empties the journal, which must end just before transaction
+   SEQ, whose CNT sectors are in commit_sectors.  Every
+   transaction in the journal was committed, so writing them home
+   again leaves the metadata on disk as it was after SEQ - 1, and
+   the journal can start over.  Of the sectors that were in it,
+   only SEQ's remain. */
+static void
+checkpoint (unsigned seq, size_t cnt)
+{
+  size_t i;
+
+  if (replay (first_txn) != seq)
+    PANIC ("journal does not end at transaction %u", seq);
+  first_txn = seq;
+  head = 1;
+  write_header (seq);
+
+  lock_acquire (&journal_lock);
+  bitmap_set_all (journaled, false);
+  for (i = 0; i < cnt; i++)
+    bitmap_mark (journaled, commit_sectors[i]);
+  lock_release (&journal_lock);
+}
+
+/* Writes a header saying that the journal starts with
+   transaction SEQ. */
+static void
+write_header (unsigned seq)
+{
+  memset (&block, 0, sizeof block);
+  block.magic = HEADER_MAGIC;
+  block.seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR, &block);
+}
@@ -0,0 +1,22 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors in the journal, starting at JOURNAL_SECTOR. */
+#define JOURNAL_SECTORS 256
+
+void journal_create (void);
+void journal_open (void);
+void journal_begin (size_t credits);
+bool journal_extend (size_t credits);
+void journal_end (void);
+unsigned journal_add (block_sector_t);
+unsigned journal_txn (void);
+bool journal_logged (block_sector_t, size_t cnt);
+void journal_commit (void);
+bool journal_reclaim (void);
+
+#endif /* filesys/journal.h */
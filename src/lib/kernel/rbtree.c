@@ -0,0 +1,388 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.  The algorithms are the
+   usual ones, as in Cormen et al., "Introduction to Algorithms",
+   except that null pointers stand for the black leaves. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void replace_child (struct rb_tree *, struct rb_elem *old,
+                           struct rb_elem *new);
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *parent);
+
+/* Returns true if E is red.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Initializes T as an empty tree that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux)
+{
+  t->root = NULL;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t)
+{
+  return t->root == NULL;
+}
+
+/* Inserts E into T.  E is placed after any elements equal to
+   it. */
+void
+rb_insert (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &t->root;
+
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+
+  /* Restore the red-black properties: while E and its parent are
+     both red, recolor or rotate. */
+  while (is_red (parent = e->parent))
+    {
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (t, parent);
+              parent = e;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (t, grandparent);
+          break;
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (t, parent);
+              parent = e;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (t, grandparent);
+          break;
+        }
+    }
+  t->root->red = false;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *child, *parent;
+  bool red;
+
+  ASSERT (e != NULL);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      child = e->left != NULL ? e->left : e->right;
+      parent = e->parent;
+      red = e->red;
+      if (child != NULL)
+        child->parent = parent;
+      replace_child (t, e, child);
+    }
+  else
+    {
+      /* E's successor, which has no left child, takes its
+         place, and the successor's right child takes the
+         successor's. */
+      struct rb_elem *next = e->right;
+      while (next->left != NULL)
+        next = next->left;
+      child = next->right;
+      red = next->red;
+      if (next->parent == e)
+        parent = next;
+      else
+        {
+          parent = next->parent;
+          parent->left = child;
+          if (child != NULL)
+            child->parent = parent;
+          next->right = e->right;
+          next->right->parent = next;
+        }
+      next->left = e->left;
+      next->left->parent = next;
+      next->parent = e->parent;
+      next->red = e->red;
+      replace_child (t, e, next);
+    }
+
+  /* Removing a black element shortens the paths through
+     CHILD. */
+  if (!red)
+    remove_fixup (t, child, parent);
+}
+
+/* Returns the last element in T that is less than or equal to
+   KEY, or a null pointer if there is none. */
+struct rb_elem *
+rb_floor (const struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *found = NULL;
+
+  while (e != NULL)
+    if (t->less (key, e, t->aux))
+      e = e->left;
+    else
+      {
+        found = e;
+        e = e->right;
+      }
+  return found;
+}
+
+/* Returns the first element in T that is greater than or equal
+   to KEY, or a null pointer if there is none. */
+struct rb_elem *
+rb_ceiling (const struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *found = NULL;
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        found = e;
+        e = e->left;
+      }
+  return found;
+}
+
+/* Returns the first element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (const struct rb_tree *t)
+{
+  struct rb_elem *e = t->root;
+
+  if (e != NULL)
+    while (e->left != NULL)
+      e = e->left;
+  return e;
+}
+
+/* Returns the last element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_last (const struct rb_tree *t)
+{
+  struct rb_elem *e = t->root;
+
+  if (e != NULL)
+    while (e->right != NULL)
+      e = e->right;
+  return e;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the last. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    {
+      e = e->right;
+      while (e->left != NULL)
+        e = e->left;
+      return e;
+    }
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+   E is the first. */
+struct rb_elem *
+rb_prev (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    {
+      e = e->left;
+      while (e->right != NULL)
+        e = e->right;
+      return e;
+    }
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Makes NEW, which may be null, take OLD's place as a child of
+   OLD's parent, or as the root of T.  Does not change NEW's
+   parent pointer. */
+static void
+replace_child (struct rb_tree *t, struct rb_elem *old, struct rb_elem *new)
+{
+  struct rb_elem *parent = old->parent;
+
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Rotates the subtree rooted at E to the left, so that E's right
+   child takes its place and E becomes that child's left
+   child. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *child = e->right;
+
+  e->right = child->left;
+  if (child->left != NULL)
+    child->left->parent = e;
+  child->parent = e->parent;
+  replace_child (t, e, child);
+  child->left = e;
+  e->parent = child;
+}
+
+/* Rotates the subtree rooted at E to the right, so that E's left
+   child takes its place and E becomes that child's right
+   child. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *child = e->left;
+
+  e->left = child->right;
+  if (child->right != NULL)
+    child->right->parent = e;
+  child->parent = e->parent;
+  replace_child (t, e, child);
+  child->right = e;
+  e->parent = child;
+}
+
+/* Restores the red-black properties of T after the removal of a
+   black element left the paths through E, a child of PARENT
+   that may be null, one black element short. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *e, struct rb_elem *parent)
+{
+  while (e != t->root && !is_red (e))
+    {
+      /* E's sibling has a black height of at least one, so it
+         is not null. */
+      if (e == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (t, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (t, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (t, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (t, parent);
+        }
+      e = t->root;
+    }
+  if (e != NULL)
+    e->red = false;
+}
@@ -0,0 +1,175 @@
+#include <lz.h>
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* A small LZ77 compressor in the style of LZF: fast, with a
+   modest compression ratio, and needing no memory beyond a
+   fixed-size hash table.
+
+   Compressed data is a sequence of items, each introduced by a
+   control byte C:
+
+     - C < 32: a literal run.  The next C + 1 bytes are copied
+       to the output as they are.
+
+     - C >= 32: a back-reference.  Its length less 2 is C >> 5,
+       or, if that is 7, 7 plus the following byte.  The next
+       byte, together with the low 5 bits of C, gives the
+       distance back less 1.  That many bytes are copied from
+       earlier in the output, possibly overlapping the bytes
+       being written.
+
+   The compressor finds matches by hashing each 3-byte sequence
+   into a table holding the position where the same hash was
+   last seen. */
+
+#define HASH_BITS 10                    /* Hash table has 2**HASH_BITS
+                                           entries. */
+#define MAX_LITERAL 32                  /* Longest literal run. */
+#define MAX_DISTANCE (1 << 13)          /* Farthest back-reference. */
+#define MAX_MATCH (2 + 7 + 255)         /* Longest back-reference. */
+
+/* Returns the hash table index for the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Appends the bytes from START up to END to *OP as literal runs,
+   without going past OP_END.  Returns false if they do not
+   fit. */
+static bool
+put_literals (uint8_t **op, uint8_t *op_end,
+              const uint8_t *start, const uint8_t *end)
+{
+  while (start < end)
+    {
+      size_t n = end - start < MAX_LITERAL ? end - start : MAX_LITERAL;
+      if ((size_t) (op_end - *op) < n + 1)
+        return false;
+      *(*op)++ = n - 1;
+      memcpy (*op, start, n);
+      *op += n;
+      start += n;
+    }
+  return true;
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes
+   at DST, using the LZ_WORK_SIZE bytes at WORK as scratch space.
+   Returns the number of bytes written to DST, or 0 if the
+   compressed data would not fit. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_size;
+  const uint8_t *ip = src;
+  const uint8_t *literal = src;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_size;
+  uint32_t *table = work;
+
+  ASSERT (sizeof *table << HASH_BITS == LZ_WORK_SIZE);
+
+  memset (table, 0, LZ_WORK_SIZE);
+  while (end - ip >= 3)
+    {
+      unsigned h = hash3 (ip);
+      const uint8_t *ref = src + table[h];
+
+      table[h] = ip - src;
+      if (ref < ip && ip - ref <= MAX_DISTANCE
+          && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+        {
+          size_t max = end - ip < MAX_MATCH ? end - ip : MAX_MATCH;
+          size_t len = 3;
+          size_t distance = ip - ref - 1;
+
+          while (len < max && ref[len] == ip[len])
+            len++;
+
+          if (!put_literals (&op, op_end, literal, ip)
+              || op_end - op < 3)
+            return 0;
+          if (len - 2 < 7)
+            *op++ = ((len - 2) << 5) | (distance >> 8);
+          else
+            {
+              *op++ = (7 << 5) | (distance >> 8);
+              *op++ = len - 2 - 7;
+            }
+          *op++ = distance & 0xff;
+
+          ip += len;
+          literal = ip;
+        }
+      else
+        ip++;
+    }
+  if (!put_literals (&op, op_end, literal, end))
+    return 0;
+  return op - dst;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into the DST_SIZE bytes at DST.  Returns the
+   number of bytes written to DST, or 0 if SRC is malformed or
+   its contents do not fit. */
+size_t
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src_;
+  const uint8_t *end = ip + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_size;
+
+  while (ip < end)
+    {
+      unsigned c = *ip++;
+
+      if (c < MAX_LITERAL)
+        {
+          size_t n = c + 1;
+          if ((size_t) (end - ip) < n || (size_t) (op_end - op) < n)
+            return 0;
+          memcpy (op, ip, n);
+          op += n;
+          ip += n;
+        }
+      else
+        {
+          size_t len = c >> 5;
+          size_t distance;
+          const uint8_t *ref;
+
+          if (len == 7)
+            {
+              if (ip >= end)
+                return 0;
+              len += *ip++;
+            }
+          if (ip >= end)
+            return 0;
+          distance = ((c & 0x1f) << 8) + *ip++ + 1;
+          len += 2;
+          if (distance > (size_t) (op - dst)
+              || len > (size_t) (op_end - op))
+            return 0;
+
+          /* The source and destination may overlap, so copy one
+             byte at a time. */
+          for (ref = op - distance; len-- > 0; )
+            *op++ = *ref++;
+        }
+    }
+  return op - dst;
+}
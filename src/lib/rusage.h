@@ -0,0 +1,23 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/* Resource usage of a process, as reported by the getrusage
+   system call.  Shared between the kernel and user programs. */
+struct rusage
+  {
+    int64_t utime;              /* Timer ticks spent in user mode. */
+    int64_t stime;              /* Timer ticks spent in kernel mode. */
+    unsigned long rss;          /* User pages currently resident. */
+    unsigned long maxrss;       /* Most user pages ever resident. */
+    unsigned long pt_pages;     /* Page directory and page table pages. */
+    unsigned long heap_bytes;   /* Kernel heap bytes allocated. */
+    unsigned long minflt;       /* Page faults served without I/O. */
+    unsigned long majflt;       /* Page faults that required I/O. */
+    unsigned long syscalls;     /* System calls made. */
+    unsigned long inblock;      /* File system sectors read. */
+    unsigned long oublock;      /* File system sectors written. */
+  };
+
+#endif /* lib/rusage.h */
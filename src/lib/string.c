@@ -1,5 +1,78 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* Blocks shorter than this are handled a byte at a time, because
+   aligning them for word operations costs more than it saves. */
+#define SMALL_BLOCK 16
+
+/* A 32-bit word that may alias objects of any type. */
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+
+/* Every byte of a word set to 0x01 or 0x80, respectively. */
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+
+/* Nonzero if any byte in word W is zero.  Aligned word reads
+   never cross a page boundary, so the string scanners below may
+   read a few bytes past the end of a string or block without
+   risking a fault. */
+#define HAS_ZERO(W) (((W) - ONES) & ~(W) & HIGHS)
+
+/* Copies SIZE bytes from SRC to DST in ascending order.  Blocks
+   of SMALL_BLOCK bytes or more are copied a word at a time once
+   DST is word-aligned. */
+static inline void
+copy_up (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  if (size >= SMALL_BLOCK)
+    {
+      size_t head = -(uintptr_t) dst & 3;
+      size_t words = (size - head) / 4;
+
+      size -= head + words * 4;
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+}
+
+/* Copies the SIZE bytes that end just below DST_END and SRC_END
+   in descending order, so that overlapping blocks with DST above
+   SRC are copied correctly. */
+static inline void
+copy_down (unsigned char *dst_end, const unsigned char *src_end,
+           size_t size)
+{
+  unsigned char *dst = dst_end;
+  const unsigned char *src = src_end;
+
+  if (size >= SMALL_BLOCK)
+    {
+      size_t words;
+
+      for (; ((uintptr_t) dst & 3) != 0; size--)
+        *--dst = *--src;
+      words = size / 4;
+      size -= words * 4;
+
+      /* With the direction flag set, movsl moves from (%esi) to
+         (%edi) and then steps both down by 4, so start each one
+         word below the end.  Interrupt entry clears the flag, so
+         it is safe to leave it set for the duration of the copy. */
+      dst -= 4;
+      src -= 4;
+      asm volatile ("std; rep movsl; cld"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+      dst += 4;
+      src += 4;
+    }
+  while (size-- > 0)
+    *--dst = *--src;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,8 +85,7 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  copy_up (dst, src, size);
 
   return dst_;
 }
@@ -30,19 +102,11 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (src != NULL || size == 0);
 
   if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
+    copy_up (dst, src, size);
+  else if (dst > src)
+    copy_down (dst + size, src + size, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -95,9 +159,19 @@ memchr (const void *block_, int ch_, size_t size)
 {
   const unsigned char *block = block_;
   unsigned char ch = ch_;
+  uint32_t pattern = ch * ONES;
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && ((uintptr_t) block & 3) != 0; size--, block++)
+    if (*block == ch)
+      return (void *) block;
+
+  /* A word contains CH if XORing it with PATTERN zeroes a byte. */
+  for (; size >= 4; size -= 4, block += 4)
+    if (HAS_ZERO (*(const word_t *) block ^ pattern))
+      break;
+
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -281,9 +355,21 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  if (size >= SMALL_BLOCK)
+    {
+      uint32_t word = (unsigned char) value * ONES;
+      size_t head = -(uintptr_t) dst & 3;
+      size_t words = (size - head) / 4;
+
+      size -= head + words * 4;
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (value) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (value) : "memory");
 
   return dst_;
 }
@@ -296,8 +382,13 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
+  for (p = string; ((uintptr_t) p & 3) != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  while (!HAS_ZERO (*(const word_t *) p))
+    p += 4;
+  while (*p != '\0')
+    p++;
   return p - string;
 }
 
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A heap allocator for user programs, built on sbrk().
+
+   Like the kernel's malloc(), the size of each request is
+   rounded up to a power of 2 and assigned to the "descriptor"
+   that manages blocks of that size.  Each descriptor keeps a
+   list of free blocks, so the common case of allocating or
+   freeing a small block only touches that list and the header
+   of the page, called an "arena", that holds the block.  When
+   a descriptor's list is empty, a new arena is divided into
+   blocks of its size.  When all of an arena's blocks are free
+   again, the arena is released.
+
+   Requests too big for any descriptor get a run of contiguous
+   pages with an arena header recording the run's length.
+
+   Pages come from a list of free runs of pages, kept in address
+   order and merged with their neighbors as they are freed.  If
+   no free run is big enough, the heap is grown with sbrk().  A
+   free run at the top of the heap is returned to the kernel.
+
+   Pintos user processes have only one thread, so there is no
+   locking.  After fork() each process has its own copy of the
+   heap and of this allocator's state. */
+
+/* Page size. */
+#define PAGE_SIZE 4096
+
+/* Free block. */
+struct block
+  {
+    struct block *prev;         /* Previous free block of same size. */
+    struct block *next;         /* Next free block of same size. */
+  };
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* Free blocks. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x5ca1ab1e
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+  };
+
+/* A run of free pages. */
+struct run
+  {
+    size_t page_cnt;            /* Number of pages. */
+    struct run *next;           /* Next run, at a higher address. */
+  };
+
+/* Our set of descriptors. */
+static struct desc descs[8];    /* Descriptors. */
+static size_t desc_cnt;         /* Number of descriptors. */
+
+/* Free runs of pages, in increasing address order. */
+static struct run *free_runs;
+
+static struct arena *block_to_arena (struct block *);
+static void *get_pages (size_t page_cnt);
+static void put_pages (void *, size_t page_cnt);
+
+/* Initializes the descriptors on first use. */
+static void
+init_descs (void)
+{
+  size_t block_size;
+
+  for (block_size = 16; block_size < PAGE_SIZE / 2; block_size *= 2)
+    {
+      struct desc *d = &descs[desc_cnt++];
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      d->block_size = block_size;
+      d->blocks_per_arena = (PAGE_SIZE - sizeof (struct arena)) / block_size;
+      d->free_list = NULL;
+    }
+}
+
+/* Removes free block B from descriptor D's free list. */
+static void
+remove_block (struct desc *d, struct block *b)
+{
+  if (b->prev != NULL)
+    b->prev->next = b->next;
+  else
+    d->free_list = b->next;
+  if (b->next != NULL)
+    b->next->prev = b->prev;
+}
+
+/* Adds free block B to the front of descriptor D's free list. */
+static void
+push_block (struct desc *d, struct block *b)
+{
+  b->prev = NULL;
+  b->next = d->free_list;
+  if (d->free_list != NULL)
+    d->free_list->prev = b;
+  d->free_list = b;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  if (desc_cnt == 0)
+    init_descs ();
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + desc_cnt)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - sizeof *a - PAGE_SIZE)
+        return NULL;
+      page_cnt = (size + sizeof *a + PAGE_SIZE - 1) / PAGE_SIZE;
+      a = get_pages (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  /* If the free list is empty, create a new arena. */
+  if (d->free_list == NULL)
+    {
+      size_t i;
+
+      a = get_pages (1);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = d->blocks_per_arena; i-- > 0; )
+        push_block (d, (struct block *) ((uint8_t *) (a + 1)
+                                         + i * d->block_size));
+    }
+
+  /* Get a block from free list and return it. */
+  b = d->free_list;
+  remove_block (d, b);
+  block_to_arena (b)->free_cnt--;
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct arena *a = block_to_arena (block);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PAGE_SIZE * a->free_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          memcpy (new_block, old_block, block_size (old_block));
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct block *b = p;
+  struct arena *a;
+  struct desc *d;
+
+  if (p == NULL)
+    return;
+
+  a = block_to_arena (b);
+  d = a->desc;
+  if (d == NULL)
+    {
+      /* It's a big block.  Free its pages. */
+      a->magic = 0;
+      put_pages (a, a->free_cnt);
+      return;
+    }
+
+  push_block (d, b);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena)
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++)
+        remove_block (d, (struct block *) ((uint8_t *) (a + 1)
+                                           + i * d->block_size));
+      a->magic = 0;
+      put_pages (a, 1);
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+  /* Check that the arena is valid. */
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || ((uintptr_t) b - (uintptr_t) (a + 1)) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || (void *) b == a + 1);
+
+  return a;
+}
+
+/* Returns the address just past the end of run R. */
+static uint8_t *
+run_end (struct run *r)
+{
+  return (uint8_t *) r + r->page_cnt * PAGE_SIZE;
+}
+
+/* Obtains PAGE_CNT contiguous pages, from a free run if one is
+   big enough and otherwise by growing the heap.  Returns a null
+   pointer if the heap cannot grow. */
+static void *
+get_pages (size_t page_cnt)
+{
+  struct run **rp, *r, *last = NULL;
+  uint8_t *brk;
+  uintptr_t ofs;
+  size_t grow_cnt;
+
+  /* First fit from the free runs. */
+  for (rp = &free_runs; (r = *rp) != NULL; rp = &r->next)
+    {
+      if (r->page_cnt == page_cnt)
+        {
+          *rp = r->next;
+          return r;
+        }
+      else if (r->page_cnt > page_cnt)
+        {
+          /* Take the pages from the end of the run, so that the
+             run stays where it is in the list. */
+          r->page_cnt -= page_cnt;
+          return run_end (r);
+        }
+      last = r;
+    }
+
+  /* Grow the heap, keeping the break page-aligned.  If the last
+     free run ends at the break, only the rest is needed. */
+  brk = sbrk (0);
+  ofs = (uintptr_t) brk % PAGE_SIZE;
+  if (ofs != 0)
+    {
+      if (sbrk (PAGE_SIZE - ofs) == (void *) -1)
+        return NULL;
+      brk += PAGE_SIZE - ofs;
+    }
+  grow_cnt = page_cnt;
+  if (last != NULL && run_end (last) == brk)
+    grow_cnt -= last->page_cnt;
+  if (grow_cnt > INTPTR_MAX / PAGE_SIZE
+      || sbrk (grow_cnt * PAGE_SIZE) == (void *) -1)
+    return NULL;
+
+  if (grow_cnt < page_cnt)
+    {
+      /* Take over the last run, which must be the end of the
+         list. */
+      for (rp = &free_runs; *rp != last; rp = &(*rp)->next)
+        continue;
+      *rp = NULL;
+      return last;
+    }
+  return brk;
+}
+
+/* Frees the PAGE_CNT pages at P, merging them with adjacent free
+   runs.  If the merged run ends at the heap's break, it is given
+   back to the kernel. */
+static void
+put_pages (void *p, size_t page_cnt)
+{
+  struct run *new = p, *prev = NULL, *next, **rp;
+
+  /* Find the runs just below and just above P. */
+  for (next = free_runs; next != NULL && (void *) next < p; next = next->next)
+    prev = next;
+
+  new->page_cnt = page_cnt;
+  new->next = next;
+  if (next != NULL && run_end (new) == (uint8_t *) next)
+    {
+      new->page_cnt += next->page_cnt;
+      new->next = next->next;
+    }
+  if (prev != NULL && run_end (prev) == (uint8_t *) new)
+    {
+      prev->page_cnt += new->page_cnt;
+      prev->next = new->next;
+      new = prev;
+    }
+  else if (prev != NULL)
+    prev->next = new;
+  else
+    free_runs = new;
+
+  /* Shrink the heap if NEW is at its top. */
+  if (new->next == NULL && run_end (new) == sbrk (0))
+    {
+      for (rp = &free_runs; *rp != new; rp = &(*rp)->next)
+        continue;
+      *rp = NULL;
+      sbrk (-(intptr_t) (new->page_cnt * PAGE_SIZE));
+    }
+}
@@ -0,0 +1,60 @@
+/* Child process for syn-stress test.
+   Repeatedly creates, writes, reads back, and removes a file of
+   its own, and reads the file shared by all the children.  Other
+   processes are doing the same at the same time. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-stress.h"
+
+const char *test_name = "child-stress";
+
+static char shared[BUF_SIZE];
+static char buf1[BUF_SIZE];
+static char buf2[BUF_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  char file_name[16];
+  int child_idx;
+  int round;
+  int fd;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "stress-%d", child_idx);
+
+  random_init (0);
+  random_bytes (shared, sizeof shared);
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      random_init (child_idx * ROUND_CNT + round + 1);
+      random_bytes (buf1, sizeof buf1);
+
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf1, sizeof buf1) == sizeof buf1,
+             "write \"%s\"", file_name);
+      seek (fd, 0);
+      CHECK (read (fd, buf2, sizeof buf2) == sizeof buf2,
+             "read \"%s\"", file_name);
+      compare_bytes (buf2, buf1, sizeof buf1, 0, file_name);
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+
+      CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+      CHECK (read (fd, buf2, sizeof buf2) == sizeof buf2,
+             "read \"%s\"", shared_name);
+      compare_bytes (buf2, shared, sizeof shared, 0, shared_name);
+      close (fd);
+    }
+
+  return child_idx;
+}
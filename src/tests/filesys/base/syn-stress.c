@@ -0,0 +1,35 @@
+/* Spawns several child processes that at the same time create,
+   write, read back, and remove files of their own and read a
+   file they all share, then verifies that the shared file is
+   intact. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/base/syn-stress.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+char buf[BUF_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd;
+
+  CHECK (create (shared_name, 0), "create \"%s\"", shared_name);
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", shared_name);
+  msg ("close \"%s\"", shared_name);
+  close (fd);
+
+  exec_children ("child-stress", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  check_file_handle (fd, shared_name, buf, sizeof buf);
+  msg ("close \"%s\"", shared_name);
+  close (fd);
+}
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_BASE_SYN_STRESS_H
+#define TESTS_FILESYS_BASE_SYN_STRESS_H
+
+#define CHILD_CNT 6
+#define ROUND_CNT 8
+#define BUF_SIZE 8192
+static const char shared_name[] = "shared";
+
+#endif /* tests/filesys/base/syn-stress.h */
@@ -0,0 +1,47 @@
+/* Creates 10,000 files in the root directory, which is enough
+   for the directory to be hashed, then opens each of them, checks
+   that a name that was never created is not found, and removes
+   them all again. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10000
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fd, i;
+
+  msg ("creating f0 through f%d", FILE_CNT - 1);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+
+  msg ("opening f0 through f%d", FILE_CNT - 1);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+
+  snprintf (name, sizeof name, "f%d", FILE_CNT);
+  CHECK (open (name) == -1, "open \"%s\" (must fail)", name);
+
+  msg ("removing f0 through f%d", FILE_CNT - 1);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-dir-xl) begin
+(grow-dir-xl) creating f0 through f9999
+(grow-dir-xl) opening f0 through f9999
+(grow-dir-xl) open "f10000" (must fail)
+(grow-dir-xl) removing f0 through f9999
+(grow-dir-xl) end
+EOF
+pass;
@@ -0,0 +1,242 @@
+/* Test program for the memory and string routines in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memchr(), and strlen()
+   against simple byte-at-a-time reference versions, for many
+   combinations of alignment and length, and then reports the
+   throughput of each routine and its reference version in bytes
+   per 100 CPU cycles.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+
+/* Largest block checked for correctness. */
+#define MAX_SIZE 96
+
+/* Size of the buffers, which leaves room for any alignment and
+   overlap of a MAX_SIZE block. */
+#define BUF_SIZE (MAX_SIZE * 3)
+
+/* Size of the block and number of repetitions used for timing. */
+#define BENCH_SIZE 4096
+#define BENCH_REPEAT 64
+
+static uint8_t buf_a[BUF_SIZE], buf_b[BUF_SIZE];
+static uint8_t bench_src[BENCH_SIZE + 1], bench_dst[BENCH_SIZE];
+
+/* Byte-at-a-time reference versions. */
+
+static void *
+byte_memcpy (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+  return dst_;
+}
+
+static void *
+byte_memmove (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  if (dst < src)
+    while (size-- > 0)
+      *dst++ = *src++;
+  else
+    {
+      dst += size;
+      src += size;
+      while (size-- > 0)
+        *--dst = *--src;
+    }
+  return dst_;
+}
+
+static void *
+byte_memset (void *dst_, int value, size_t size)
+{
+  unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+  return dst_;
+}
+
+static void *
+byte_memchr (const void *block_, int ch_, size_t size)
+{
+  const unsigned char *block = block_;
+  unsigned char ch = ch_;
+
+  for (; size-- > 0; block++)
+    if (*block == ch)
+      return (void *) block;
+  return NULL;
+}
+
+static size_t
+byte_strlen (const char *string)
+{
+  const char *p;
+
+  for (p = string; *p != '\0'; p++)
+    continue;
+  return p - string;
+}
+
+/* Fills both buffers with the same random bytes, none of which
+   is zero. */
+static void
+fill_buffers (void)
+{
+  size_t i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    buf_a[i] = buf_b[i] = random_ulong () % 255 + 1;
+}
+
+static void
+verify_buffers (const char *name, size_t dst, size_t src, size_t size)
+{
+  if (memcmp (buf_a, buf_b, BUF_SIZE))
+    PANIC ("%s: mismatch with dst=%zu, src=%zu, size=%zu",
+           name, dst, src, size);
+}
+
+/* Checks the optimized routines against the reference versions
+   for every source and destination alignment within a word and
+   every size up to MAX_SIZE. */
+static void
+verify (void)
+{
+  size_t dst, src, size;
+
+  for (dst = 0; dst < 4; dst++)
+    for (src = 0; src < 4; src++)
+      for (size = 0; size <= MAX_SIZE; size++)
+        {
+          size_t lo = MAX_SIZE + src, hi = MAX_SIZE + dst;
+
+          fill_buffers ();
+          ASSERT (memcpy (buf_a + dst, buf_a + lo, size) == buf_a + dst);
+          byte_memcpy (buf_b + dst, buf_b + lo, size);
+          verify_buffers ("memcpy", dst, lo, size);
+
+          /* Overlapping moves in both directions. */
+          fill_buffers ();
+          ASSERT (memmove (buf_a + hi + size / 2, buf_a + hi, size)
+                  == buf_a + hi + size / 2);
+          byte_memmove (buf_b + hi + size / 2, buf_b + hi, size);
+          verify_buffers ("memmove up", hi + size / 2, hi, size);
+
+          fill_buffers ();
+          ASSERT (memmove (buf_a + hi, buf_a + hi + size / 2, size)
+                  == buf_a + hi);
+          byte_memmove (buf_b + hi, buf_b + hi + size / 2, size);
+          verify_buffers ("memmove down", hi, hi + size / 2, size);
+
+          fill_buffers ();
+          ASSERT (memset (buf_a + dst, src, size) == buf_a + dst);
+          byte_memset (buf_b + dst, src, size);
+          verify_buffers ("memset", dst, src, size);
+
+          /* memchr() for a byte at each position, and strlen() of
+             a string of each length. */
+          fill_buffers ();
+          buf_a[lo + size] = buf_b[lo + size] = 0;
+          ASSERT (memchr (buf_a + src, 0, size)
+                  == byte_memchr (buf_a + src, 0, size));
+          ASSERT (memchr (buf_a + lo, 0, size + 1) == buf_a + lo + size);
+          ASSERT (memchr (buf_a + lo, buf_a[lo + dst], size)
+                  == byte_memchr (buf_a + lo, buf_a[lo + dst], size));
+          ASSERT (strlen ((char *) buf_a + lo) == size);
+          ASSERT (byte_strlen ((char *) buf_a + lo) == size);
+        }
+}
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Prints the throughput of running TASK on BENCH_SIZE bytes,
+   BENCH_REPEAT times, with the blocks misaligned by OFS bytes.
+   TASK is a statement that uses DST, SRC, and SIZE. */
+#define BENCH(NAME, OFS, TASK)                                  \
+        do {                                                    \
+          uint8_t *dst = bench_dst + (OFS);                     \
+          const uint8_t *src = bench_src + (OFS);               \
+          size_t size = BENCH_SIZE - 4;                         \
+          uint64_t start;                                       \
+          int i;                                                \
+                                                                \
+          (void) dst;                                           \
+          (void) src;                                           \
+          start = rdtsc ();                                     \
+          for (i = 0; i < BENCH_REPEAT; i++)                    \
+            TASK;                                               \
+          print_rate (NAME, (uint64_t) size * BENCH_REPEAT,     \
+                      rdtsc () - start);                        \
+        } while (0)
+
+static void
+print_rate (const char *name, uint64_t bytes, uint64_t cycles)
+{
+  printf ("  %-14s %6llu bytes/100 cycles\n",
+          name, cycles > 0 ? bytes * 100 / cycles : 0);
+}
+
+/* Compares the throughput of each routine with its reference
+   version, on aligned and misaligned blocks. */
+static void
+benchmark (void)
+{
+  volatile size_t sink;
+  int ofs;
+
+  memset (bench_src, 'x', BENCH_SIZE);
+  bench_src[BENCH_SIZE - 4] = '\0';
+
+  for (ofs = 0; ofs < 4; ofs += 3)
+    {
+      printf ("throughput, offset %d:\n", ofs);
+      BENCH ("memcpy", ofs, memcpy (dst, src, size));
+      BENCH ("byte_memcpy", ofs, byte_memcpy (dst, src, size));
+      BENCH ("memmove", ofs, memmove (dst, dst + 1, size - 1));
+      BENCH ("byte_memmove", ofs, byte_memmove (dst, dst + 1, size - 1));
+      BENCH ("memset", ofs, memset (dst, i, size));
+      BENCH ("byte_memset", ofs, byte_memset (dst, i, size));
+      BENCH ("memchr", ofs, sink = memchr (src, 0, size) != NULL);
+      BENCH ("byte_memchr", ofs, sink = byte_memchr (src, 0, size) != NULL);
+      BENCH ("strlen", ofs, sink = strlen ((const char *) src));
+      BENCH ("byte_strlen", ofs, sink = byte_strlen ((const char *) src));
+    }
+  (void) sink;
+}
+
+/* Tests and benchmarks the memory and string routines. */
+void
+test (void)
+{
+  printf ("testing memory and string routines...");
+  verify ();
+  printf (" done\n");
+  benchmark ();
+}
@@ -0,0 +1,114 @@
+/* Allocates, resizes, and frees many blocks of assorted sizes
+   with malloc(), calloc(), realloc(), and free(), checking that
+   blocks keep their contents and do not overlap, and that the
+   heap shrinks back to its start once everything is freed. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 64            /* Blocks live at once, at most. */
+#define ROUNDS 4000             /* Allocations, resizes and frees. */
+
+static uint8_t *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+
+/* Returns a random block size, usually small but sometimes
+   spanning several pages. */
+static size_t
+random_size (void)
+{
+  return (random_ulong () % 8 == 0
+          ? random_ulong () % (4 * 4096) + 1
+          : random_ulong () % 300 + 1);
+}
+
+/* Returns the byte that belongs at offset OFS in block I. */
+static uint8_t
+pattern (int i, size_t ofs)
+{
+  return i * 37 + ofs;
+}
+
+/* Fills block I with its pattern. */
+static void
+fill (int i)
+{
+  size_t ofs;
+
+  for (ofs = 0; ofs < sizes[i]; ofs++)
+    blocks[i][ofs] = pattern (i, ofs);
+}
+
+/* Checks the first SIZE bytes of block I against its pattern. */
+static void
+verify (int i, size_t size)
+{
+  size_t ofs;
+
+  for (ofs = 0; ofs < size; ofs++)
+    if (blocks[i][ofs] != pattern (i, ofs))
+      fail ("block %d of %zu bytes corrupted at offset %zu",
+            i, sizes[i], ofs);
+}
+
+void
+test_main (void) 
+{
+  uint8_t *start = sbrk (0);
+  uint8_t *zeros;
+  int round, i;
+
+  random_init (0);
+  msg ("allocate, resize, and free blocks");
+  for (round = 0; round < ROUNDS; round++)
+    {
+      i = random_ulong () % BLOCK_CNT;
+      if (blocks[i] == NULL)
+        {
+          sizes[i] = random_size ();
+          blocks[i] = malloc (sizes[i]);
+          if (blocks[i] == NULL)
+            fail ("malloc (%zu) failed", sizes[i]);
+          fill (i);
+        }
+      else if (random_ulong () % 2)
+        {
+          size_t new_size = random_size ();
+          verify (i, sizes[i]);
+          blocks[i] = realloc (blocks[i], new_size);
+          if (blocks[i] == NULL)
+            fail ("realloc (%zu) failed", new_size);
+          verify (i, new_size < sizes[i] ? new_size : sizes[i]);
+          sizes[i] = new_size;
+          fill (i);
+        }
+      else
+        {
+          verify (i, sizes[i]);
+          free (blocks[i]);
+          blocks[i] = NULL;
+        }
+    }
+
+  msg ("free remaining blocks");
+  for (i = 0; i < BLOCK_CNT; i++)
+    if (blocks[i] != NULL)
+      {
+        verify (i, sizes[i]);
+        free (blocks[i]);
+      }
+
+  zeros = calloc (1000, 5);
+  CHECK (zeros != NULL, "calloc (1000, 5)");
+  for (i = 0; i < 5000; i++)
+    if (zeros[i] != 0)
+      fail ("byte %d of calloc'd block is %d, not 0", i, zeros[i]);
+  free (zeros);
+
+  CHECK (sbrk (0) == start, "heap shrank back to its start");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc) begin
+(malloc) allocate, resize, and free blocks
+(malloc) free remaining blocks
+(malloc) calloc (1000, 5)
+(malloc) heap shrank back to its start
+(malloc) end
+malloc: exit(0)
+EOF
+pass;
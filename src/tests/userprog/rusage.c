@@ -0,0 +1,28 @@
+/* Checks that the getrusage system call reports the calling
+   process's system calls, CPU time and memory. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct rusage before, after;
+  int i;
+
+  CHECK (getrusage (&before), "getrusage");
+  for (i = 0; i < 10; i++)
+    filesize (0);
+  CHECK (getrusage (&after), "getrusage");
+
+  if (after.syscalls < before.syscalls + 11)
+    fail ("%lu system calls counted, expected at least %lu",
+          after.syscalls, before.syscalls + 11);
+  if (after.utime < before.utime || after.stime < before.stime)
+    fail ("CPU time went backward");
+  if (after.maxrss == 0 || after.rss > after.maxrss)
+    fail ("bad resident set size %lu, peak %lu", after.rss, after.maxrss);
+  if (after.pt_pages == 0)
+    fail ("no page table pages counted");
+}
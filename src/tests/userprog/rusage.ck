@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rusage) begin
+(rusage) getrusage
+(rusage) getrusage
+(rusage) end
+rusage: exit(0)
+EOF
+pass;
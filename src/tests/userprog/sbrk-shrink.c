@@ -0,0 +1,20 @@
+/* Shrinks the heap with sbrk() and then touches memory that is
+   no longer part of it.  The process must be terminated with
+   -1 exit code. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  uint8_t *start = sbrk (0);
+
+  CHECK (sbrk (4096) == start, "sbrk (4096)");
+  start[0] = 1;
+  CHECK (sbrk (-4096) == start + 4096, "sbrk (-4096)");
+  start[0] = 2;
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(sbrk-shrink) begin
+(sbrk-shrink) sbrk (4096)
+(sbrk-shrink) sbrk (-4096)
+sbrk-shrink: exit(-1)
+EOF
+pass;
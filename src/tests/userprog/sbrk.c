@@ -0,0 +1,34 @@
+/* Grows the heap with sbrk(), checks that the new memory is
+   zeroed and writable, and moves the break back down with
+   sbrk() and brk(). */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Grow by a few pages and a bit more. */
+#define GROW (3 * 4096 + 100)
+
+void
+test_main (void) 
+{
+  uint8_t *start = sbrk (0);
+  size_t i;
+
+  CHECK (sbrk (GROW) == start, "sbrk (%d)", GROW);
+  CHECK (sbrk (0) == start + GROW, "break moved up");
+  for (i = 0; i < GROW; i++)
+    if (start[i] != 0)
+      fail ("byte %zu of new heap is %d, not 0", i, start[i]);
+  memset (start, 0x5a, GROW);
+
+  CHECK (sbrk (-GROW) == start + GROW, "sbrk (-%d)", GROW);
+  CHECK (sbrk (-1) == (void *) -1, "sbrk below heap start fails");
+  CHECK (sbrk (0) == start, "break unchanged by failures");
+
+  CHECK (brk (start + 4096) == 0, "brk");
+  start[0] = start[4095] = 1;
+  CHECK (brk (start) == 0, "brk back to start");
+}
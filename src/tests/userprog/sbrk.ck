@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sbrk) begin
+(sbrk) sbrk (12388)
+(sbrk) break moved up
+(sbrk) sbrk (-12388)
+(sbrk) sbrk below heap start fails
+(sbrk) break unchanged by failures
+(sbrk) brk
+(sbrk) brk back to start
+(sbrk) end
+sbrk: exit(0)
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Forks, then has the child modify data, bss and stack pages
+   that it shares copy-on-write with the parent, and verifies
+   that each process sees only its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+static int data = 1;
+
+static bool
+all (const char *p, size_t size, char c)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  char stack_obj[4096];
+  pid_t child;
+
+  memset (buf, 'p', SIZE);
+  memset (stack_obj, 'p', sizeof stack_obj);
+
+  child = fork ();
+  if (child == 0)
+    {
+      CHECK (all (buf, SIZE, 'p') && all (stack_obj, sizeof stack_obj, 'p')
+             && data == 1, "child sees parent's data");
+      memset (buf, 'c', SIZE);
+      memset (stack_obj, 'c', sizeof stack_obj);
+      data = 2;
+      CHECK (all (buf, SIZE, 'c') && all (stack_obj, sizeof stack_obj, 'c')
+             && data == 2, "child modified its copy");
+      exit (42);
+    }
+
+  if (child == PID_ERROR)
+    fail ("fork failed");
+  CHECK (wait (child) == 42, "wait for child");
+  CHECK (all (buf, SIZE, 'p') && all (stack_obj, sizeof stack_obj, 'p')
+         && data == 1, "parent's data unchanged");
+}
@@ -1,12 +1,16 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,7 +36,17 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   If malloc_track is set by the "-mt" kernel command-line
+   option, every live block is also recorded in a side table,
+   together with its size and the address of the code that
+   allocated it, and each such call site keeps counts of the
+   blocks and bytes it has allocated.  malloc_print_stats()
+   lists the blocks still allocated at shutdown and the call
+   sites that allocated the most bytes; the addresses can be
+   turned into function names and line numbers with
+   utils/backtrace. */
 
 /* Descriptor. */
 struct desc
@@ -64,8 +78,48 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Allocation tracking. */
+bool malloc_track;
+
+/* Sizes of the tracking tables, which must be powers of 2.
+   Each table is at most 3/4 filled, so that probe sequences
+   stay short; allocations that do not fit are not tracked. */
+#define LIVE_SLOTS 4096         /* Live blocks. */
+#define SITE_SLOTS 512          /* Allocation sites. */
+
+/* A live block, in the table of live blocks. */
+struct live_block
+  {
+    void *block;                /* Block, or null if slot is empty. */
+    void *caller;               /* Address that allocated BLOCK. */
+    size_t size;                /* Requested size of BLOCK. */
+  };
+
+/* A call site of malloc(), calloc(), or realloc(). */
+struct alloc_site
+  {
+    void *caller;               /* Return address, or null if empty. */
+    unsigned long alloc_cnt;    /* Blocks allocated. */
+    unsigned long long alloc_bytes; /* Bytes allocated. */
+    size_t live_cnt;            /* Blocks not yet freed. */
+    size_t live_bytes;          /* Bytes not yet freed. */
+  };
+
+/* Tracking tables, protected by disabling interrupts so that
+   they may be printed from a kernel panic. */
+static struct live_block *live_blocks;  /* Live blocks. */
+static size_t live_cnt;                 /* Entries in LIVE_BLOCKS. */
+static struct alloc_site *alloc_sites;  /* Allocation sites. */
+static size_t site_cnt;                 /* Entries in ALLOC_SITES. */
+static unsigned long untracked_cnt;     /* Allocations not tracked. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *alloc_block (size_t);
+static void free_block (void *);
+static size_t block_size (void *);
+static void track_alloc (void *, size_t, void *caller);
+static void track_free (void *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -82,12 +136,95 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+
+  if (malloc_track)
+    {
+      size_t live_pages = DIV_ROUND_UP (LIVE_SLOTS * sizeof *live_blocks,
+                                        PGSIZE);
+      size_t site_pages = DIV_ROUND_UP (SITE_SLOTS * sizeof *alloc_sites,
+                                        PGSIZE);
+      live_blocks = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, live_pages);
+      alloc_sites = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, site_pages);
+    }
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = alloc_block (size);
+  track_alloc (p, size, __builtin_return_address (0));
+  return p;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = alloc_block (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  track_alloc (p, size, __builtin_return_address (0));
+
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  if (new_size == 0) 
+    {
+      free (old_block);
+      return NULL;
+    }
+  else 
+    {
+      void *new_block = alloc_block (new_size);
+      track_alloc (new_block, new_size, __builtin_return_address (0));
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t old_size = block_size (old_block);
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  if (p != NULL)
+    {
+      track_free (p);
+      free_block (p);
+    }
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+static void *
+alloc_block (size_t size) 
 {
   struct desc *d;
   struct block *b;
@@ -116,6 +253,7 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      thread_current ()->usage.heap_bytes += page_cnt * PGSIZE;
       return a + 1;
     }
 
@@ -150,30 +288,10 @@ malloc (size_t size)
   a = block_to_arena (b);
   a->free_cnt--;
   lock_release (&d->lock);
+  thread_current ()->usage.heap_bytes += d->block_size;
   return b;
 }
 
-/* Allocates and return A times B bytes initialized to zeroes.
-   Returns a null pointer if memory is not available. */
-void *
-calloc (size_t a, size_t b) 
-{
-  void *p;
-  size_t size;
-
-  /* Calculate block size and make sure it fits in size_t. */
-  size = a * b;
-  if (size < a || size < b)
-    return NULL;
-
-  /* Allocate and zero memory. */
-  p = malloc (size);
-  if (p != NULL)
-    memset (p, 0, size);
-
-  return p;
-}
-
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) 
@@ -185,38 +303,10 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
-/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
-   moving it in the process.
-   If successful, returns the new block; on failure, returns a
-   null pointer.
-   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
-void *
-realloc (void *old_block, size_t new_size) 
-{
-  if (new_size == 0) 
-    {
-      free (old_block);
-      return NULL;
-    }
-  else 
-    {
-      void *new_block = malloc (new_size);
-      if (old_block != NULL && new_block != NULL)
-        {
-          size_t old_size = block_size (old_block);
-          size_t min_size = new_size < old_size ? new_size : old_size;
-          memcpy (new_block, old_block, min_size);
-          free (old_block);
-        }
-      return new_block;
-    }
-}
-
-/* Frees block P, which must have been previously allocated with
-   malloc(), calloc(), or realloc(). */
-void
-free (void *p) 
+/* Frees block P, which must have been allocated with
+   alloc_block(). */
+static void
+free_block (void *p) 
 {
   if (p != NULL)
     {
@@ -263,6 +353,185 @@ free (void *p)
     }
 }
 
+/* Returns the slot in the table of live blocks for BLOCK, which
+   is empty if BLOCK is not in the table. */
+static struct live_block *
+find_live (const void *block)
+{
+  size_t i = hash_int ((uintptr_t) block) & (LIVE_SLOTS - 1);
+
+  while (live_blocks[i].block != NULL && live_blocks[i].block != block)
+    i = (i + 1) & (LIVE_SLOTS - 1);
+  return &live_blocks[i];
+}
+
+/* Removes live block E from its table.  Later entries in E's
+   probe sequence are moved up, so that lookups never have to
+   skip over deleted entries. */
+static void
+remove_live (struct live_block *e)
+{
+  size_t i = e - live_blocks;
+  size_t j = i;
+
+  for (;;)
+    {
+      size_t home;
+
+      j = (j + 1) & (LIVE_SLOTS - 1);
+      if (live_blocks[j].block == NULL)
+        break;
+
+      /* The entry in slot J may move to slot I only if its home
+         slot does not lie cyclically in (I, J]. */
+      home = hash_int ((uintptr_t) live_blocks[j].block) & (LIVE_SLOTS - 1);
+      if (i <= j ? i < home && home <= j : i < home || home <= j)
+        continue;
+      live_blocks[i] = live_blocks[j];
+      i = j;
+    }
+  live_blocks[i].block = NULL;
+  live_cnt--;
+}
+
+/* Returns the entry for allocation site CALLER, creating it if
+   necessary, or a null pointer if the site table is full. */
+static struct alloc_site *
+find_site (void *caller)
+{
+  size_t i = hash_int ((uintptr_t) caller) & (SITE_SLOTS - 1);
+
+  while (alloc_sites[i].caller != NULL && alloc_sites[i].caller != caller)
+    i = (i + 1) & (SITE_SLOTS - 1);
+  if (alloc_sites[i].caller == NULL)
+    {
+      if (site_cnt >= SITE_SLOTS / 4 * 3)
+        return NULL;
+      alloc_sites[i].caller = caller;
+      site_cnt++;
+    }
+  return &alloc_sites[i];
+}
+
+/* Records that CALLER allocated block P of SIZE bytes, if
+   tracking is enabled and P is not null. */
+static void
+track_alloc (void *p, size_t size, void *caller)
+{
+  enum intr_level old_level;
+  struct alloc_site *site;
+  struct live_block *e;
+
+  if (live_blocks == NULL || p == NULL)
+    return;
+
+  old_level = intr_disable ();
+  site = find_site (caller);
+  if (site != NULL && live_cnt < LIVE_SLOTS / 4 * 3)
+    {
+      site->alloc_cnt++;
+      site->alloc_bytes += size;
+      site->live_cnt++;
+      site->live_bytes += size;
+
+      e = find_live (p);
+      ASSERT (e->block == NULL);
+      e->block = p;
+      e->caller = caller;
+      e->size = size;
+      live_cnt++;
+    }
+  else
+    untracked_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that block P is being freed, if tracking is
+   enabled. */
+static void
+track_free (void *p)
+{
+  enum intr_level old_level;
+  struct live_block *e;
+
+  if (live_blocks == NULL)
+    return;
+
+  old_level = intr_disable ();
+  e = find_live (p);
+  if (e->block != NULL)
+    {
+      struct alloc_site *site = find_site (e->caller);
+      site->live_cnt--;
+      site->live_bytes -= e->size;
+      remove_live (e);
+    }
+  intr_set_level (old_level);
+}
+
+/* Number of outstanding blocks and allocation sites listed by
+   malloc_print_stats(). */
+#define PRINT_LIVE 32
+#define PRINT_SITES 10
+
+/* Orders allocation sites by descending bytes allocated, with
+   empty slots last. */
+static int
+compare_sites (const void *a_, const void *b_)
+{
+  const struct alloc_site *a = a_;
+  const struct alloc_site *b = b_;
+
+  if (a->alloc_bytes != b->alloc_bytes)
+    return a->alloc_bytes > b->alloc_bytes ? -1 : 1;
+  return 0;
+}
+
+/* Prints the blocks that are still allocated and the call sites
+   that allocated the most bytes, if tracking is enabled.
+   Tracking stops afterward, since the site table is sorted in
+   place. */
+void
+malloc_print_stats (void)
+{
+  enum intr_level old_level;
+  size_t live_bytes = 0;
+  size_t i, printed;
+
+  if (live_blocks == NULL)
+    return;
+
+  old_level = intr_disable ();
+  for (i = 0; i < LIVE_SLOTS; i++)
+    live_bytes += live_blocks[i].block != NULL ? live_blocks[i].size : 0;
+  printf ("Malloc: %zu blocks (%zu bytes) outstanding, "
+          "%lu allocations not tracked\n",
+          live_cnt, live_bytes, untracked_cnt);
+
+  for (i = printed = 0; i < LIVE_SLOTS && printed < PRINT_LIVE; i++)
+    if (live_blocks[i].block != NULL)
+      {
+        printf ("  %p: %zu bytes from %p\n", live_blocks[i].block,
+                live_blocks[i].size, live_blocks[i].caller);
+        printed++;
+      }
+  if (printed < live_cnt)
+    printf ("  ...and %zu more\n", live_cnt - printed);
+
+  qsort (alloc_sites, SITE_SLOTS, sizeof *alloc_sites, compare_sites);
+  live_blocks = NULL;
+  printf ("Malloc: top allocation sites by bytes allocated:\n");
+  for (i = 0; i < PRINT_SITES && i < site_cnt; i++)
+    {
+      struct alloc_site *site = &alloc_sites[i];
+      printf ("  %p: %lu blocks, %llu bytes; %zu blocks, "
+              "%zu bytes outstanding\n",
+              site->caller, site->alloc_cnt, site->alloc_bytes,
+              site->live_cnt, site->live_bytes);
+    }
+  intr_set_level (old_level);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
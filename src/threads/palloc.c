@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,7 +24,16 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool also keeps a few free pages that are already zeroed,
+   filled in by the idle thread, so that single-page PAL_ZERO
+   requests need not clear memory on the critical path.  These
+   pages are marked used in the pool's bitmap and handed out to
+   any request once the bitmap runs out. */
+
+/* Number of pre-zeroed pages kept in each pool. */
+#define ZERO_POOL_SIZE 16
 
 /* A memory pool. */
 struct pool
@@ -31,14 +41,43 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Pre-zeroed pages.  Only the idle thread adds pages, and
+       it must not block on LOCK, so these are protected by
+       disabling interrupts instead. */
+    void *zero_pages[ZERO_POOL_SIZE];   /* Zeroed free pages. */
+    size_t zero_cnt;                    /* Number of ZERO_PAGES. */
+
+    /* Free pages, including pre-zeroed ones.  Also protected by
+       disabling interrupts, since pages are freed without
+       LOCK. */
+    size_t free_cnt;
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Statistics. */
+static long long zero_hits;       /* PAL_ZERO pages taken pre-zeroed. */
+static long long zero_misses;     /* PAL_ZERO pages zeroed on demand. */
+static long long idle_zeroed;     /* Pages zeroed by the idle thread. */
+static uint64_t demand_cycles;    /* Cycles spent zeroing on demand. */
+static uint64_t idle_cycles;      /* Cycles spent zeroing while idle. */
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *take_zero_page (struct pool *);
+static bool refill_zero_pool (struct pool *);
+
+/* Returns the processor's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -77,19 +116,41 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = take_zero_page (pool);
+      if (pages != NULL)
+        {
+          zero_hits++;
+          return pages;
+        }
+    }
+
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    {
+      enum intr_level old_level = intr_disable ();
+      pool->free_cnt -= page_cnt;
+      intr_set_level (old_level);
+      pages = pool->base + PGSIZE * page_idx;
+    }
+  else if (page_cnt == 1)
+    pages = take_zero_page (pool);
   else
     pages = NULL;
 
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          uint64_t start = rdtsc ();
+          memset (pages, 0, PGSIZE * page_cnt);
+          demand_cycles += rdtsc () - start;
+          zero_misses++;
+        }
     }
   else 
     {
@@ -119,6 +180,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -139,6 +201,10 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+
+  old_level = intr_disable ();
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,6 +214,160 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Initializes BATCH as empty. */
+void
+palloc_batch_init (struct palloc_batch *batch)
+{
+  batch->page_cnt = 0;
+}
+
+/* Adds PAGE to the pages to be freed by BATCH, first freeing the
+   batch if it is full. */
+void
+palloc_batch_add (struct palloc_batch *batch, void *page)
+{
+  ASSERT (pg_ofs (page) == 0);
+
+  if (batch->page_cnt >= PALLOC_BATCH_SIZE)
+    palloc_batch_flush (batch);
+  batch->pages[batch->page_cnt++] = page;
+}
+
+/* Frees every page in BATCH and leaves BATCH empty.  Each pool's
+   lock is acquired, and its free count updated, once for the
+   whole batch. */
+void
+palloc_batch_flush (struct palloc_batch *batch)
+{
+  struct pool *pools[] = { &kernel_pool, &user_pool };
+  size_t i, j;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      enum intr_level old_level;
+      size_t freed = 0;
+
+      for (j = 0; j < batch->page_cnt; j++)
+        if (page_from_pool (pool, batch->pages[j]))
+          break;
+      if (j >= batch->page_cnt)
+        continue;
+
+      lock_acquire (&pool->lock);
+      for (; j < batch->page_cnt; j++)
+        {
+          void *page = batch->pages[j];
+          size_t page_idx;
+
+          if (!page_from_pool (pool, page))
+            continue;
+          page_idx = pg_no (page) - pg_no (pool->base);
+#ifndef NDEBUG
+          memset (page, 0xcc, PGSIZE);
+#endif
+          ASSERT (bitmap_test (pool->used_map, page_idx));
+          bitmap_reset (pool->used_map, page_idx);
+          freed++;
+        }
+      lock_release (&pool->lock);
+
+      old_level = intr_disable ();
+      pool->free_cnt += freed;
+      intr_set_level (old_level);
+    }
+  batch->page_cnt = 0;
+}
+
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool. */
+size_t
+palloc_free_pages (enum palloc_flags flags)
+{
+  const struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  return pool->free_cnt;
+}
+
+/* Zeroes a free page for the pool of pre-zeroed pages of either
+   pool, if one is not full.  Called by the idle thread, so it
+   never blocks or holds a lock while it can be preempted.
+   Returns false if there was nothing to do. */
+bool
+palloc_zero_idle (void)
+{
+  return refill_zero_pool (&kernel_pool) || refill_zero_pool (&user_pool);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Palloc: %lld zeroed-page hits, %lld misses, "
+          "%lld pages zeroed while idle\n",
+          zero_hits, zero_misses, idle_zeroed);
+  printf ("Palloc: %"PRIu64" cycles zeroing on demand, "
+          "%"PRIu64" cycles zeroing while idle\n",
+          demand_cycles, idle_cycles);
+}
+
+/* Removes and returns a pre-zeroed page from POOL, or a null
+   pointer if there is none. */
+static void *
+take_zero_page (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  void *page = NULL;
+  if (pool->zero_cnt > 0)
+    {
+      page = pool->zero_pages[--pool->zero_cnt];
+      pool->free_cnt--;
+    }
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Moves one free page of POOL into its pre-zeroed pages, unless
+   they are full, POOL has no free page, or POOL's lock is busy.
+   Returns true if a page was added.
+
+   The idle thread only runs when no other thread is ready, so if
+   it were preempted while holding POOL's lock, a thread waiting
+   for the lock would wait until every other thread blocked.
+   Priority donation cannot help, because the idle thread is
+   never on the ready list.  So it takes the lock, scans the
+   bitmap, and releases the lock with interrupts disabled, which
+   also means that nobody can be waiting for the lock when it is
+   released. */
+static bool
+refill_zero_pool (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  uint8_t *page;
+  uint64_t start;
+
+  old_level = intr_disable ();
+  if (pool->zero_cnt < ZERO_POOL_SIZE && lock_try_acquire (&pool->lock))
+    {
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+      lock_release (&pool->lock);
+    }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  start = rdtsc ();
+  memset (page, 0, PGSIZE);
+  idle_cycles += rdtsc () - start;
+  idle_zeroed++;
+
+  old_level = intr_disable ();
+  pool->zero_pages[pool->zero_cnt++] = page;
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -167,6 +387,8 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->zero_cnt = 0;
+  p->free_cnt = page_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
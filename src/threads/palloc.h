@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +12,30 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Maximum number of pages held by a palloc_batch. */
+#define PALLOC_BATCH_SIZE 32
+
+/* Pages waiting to be freed together, so that freeing many
+   scattered pages updates each pool once rather than once per
+   page.  Initialize with palloc_batch_init(), add pages with
+   palloc_batch_add(), and free whatever is left with
+   palloc_batch_flush(). */
+struct palloc_batch
+  {
+    void *pages[PALLOC_BATCH_SIZE];
+    size_t page_cnt;
+  };
+
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_batch_init (struct palloc_batch *);
+void palloc_batch_add (struct palloc_batch *, void *page);
+void palloc_batch_flush (struct palloc_batch *);
+size_t palloc_free_pages (enum palloc_flags);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
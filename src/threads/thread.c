@@ -17,6 +17,9 @@
 #include "userprog/process.h"
 #include "userprog/syscall.h"
 #endif
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -129,13 +132,18 @@ thread_start (void)
 }
 
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+   USER is true if the tick interrupted user mode.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user)
 {
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  if (user)
+    t->usage.utime++;
+  else if (t != idle_thread)
+    t->usage.stime++;
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
@@ -221,6 +229,13 @@ thread_create (const char *name, int priority,
   struct child_process *cp = add_cp(t->tid);
   t->cp = cp;
 
+#ifdef FILESYS
+  /* A new thread starts out in its creator's working directory,
+     or in the root if a copy cannot be made. */
+  if (thread_current ()->cwd != NULL)
+    t->cwd = dir_reopen (thread_current ()->cwd);
+#endif
+
   /* Add to run queue. */
   thread_unblock (t);
   change_thread_priority(); /*change thread priority if needed*/
@@ -573,7 +588,9 @@ thread_renew_priorities_mlfqs(void)
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   special case when the ready list is empty, at which point it
+   zeroes free pages for the page allocator until there is
+   nothing left to zero or another thread becomes ready. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
@@ -587,6 +604,16 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Use the idle time to pre-zero pages.  An interrupt may
+         wake a thread meanwhile, in which case we must not halt
+         below. */
+      intr_enable ();
+      while (list_empty (&ready_list) && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (!list_empty (&ready_list))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -666,6 +693,10 @@ init_thread (struct thread *t, const char *name, int priority)
   t->parent = -1;             // there is no parent yet
   list_init(&t->lock_list);
   t->exe_file = NULL;
+#ifdef VM
+  list_init(&t->mmap_list);
+  t->next_mapid = 0;
+#endif
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -3,7 +3,12 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rusage.h>
 #include <stdint.h>
+#ifdef VM
+#include <hash.h>
+#include "vm/page.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -106,7 +111,33 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    uint8_t *heap_start;                /* Start of heap, above data. */
+    uint8_t *heap_brk;                  /* End of heap ("break"). */
+#endif
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, or null for root. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal operations. */
+    size_t journal_credits;             /* Sectors left in reservation. */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct readahead exe_ra;            /* Executable read-ahead state. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mmap_list;              /* Memory-mapped files. */
+    int next_mapid;                     /* Identifier for next mapping. */
+
+    /* Owned by userprog/syscall.c. */
+    void *user_esp;                     /* User stack pointer in syscall. */
+#endif
+
+    /* Resource usage, updated by the code that consumes each
+       resource on the running thread's behalf. */
+    struct rusage usage;
 
     /* Owned by thread.c. */
     unsigned magic;      
@@ -128,7 +159,7 @@ extern bool thread_mlfqs;
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -0,0 +1,98 @@
+#include "userprog/acct.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Process accounting.  When a process exits, its resource usage
+   is added to a per-program total, so that the table printed at
+   power-off shows which workloads consumed the machine.  Peak
+   resident set size is the largest of any run; every other
+   counter is summed over all runs.
+
+   The table has a fixed size so that recording an exit never
+   allocates memory.  Programs that do not fit are lumped
+   together in the last entry. */
+
+#define ACCT_CNT 32             /* Number of table entries. */
+
+/* Resource usage totals for one program. */
+struct acct
+  {
+    char name[16];              /* Program name, empty if unused. */
+    int runs;                   /* Number of processes that exited. */
+    struct rusage usage;        /* Totals. */
+  };
+
+static struct acct acct_table[ACCT_CNT];
+
+static struct acct *acct_find (const char *name);
+
+/* Adds the resource usage of T, which is exiting, to the totals
+   for its program. */
+void
+acct_exit (const struct thread *t)
+{
+  const struct rusage *u = &t->usage;
+  struct acct *a;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  a = acct_find (t->name);
+  a->runs++;
+  a->usage.utime += u->utime;
+  a->usage.stime += u->stime;
+  if (u->maxrss > a->usage.maxrss)
+    a->usage.maxrss = u->maxrss;
+  a->usage.pt_pages += u->pt_pages;
+  a->usage.heap_bytes += u->heap_bytes;
+  a->usage.minflt += u->minflt;
+  a->usage.majflt += u->majflt;
+  a->usage.syscalls += u->syscalls;
+  a->usage.inblock += u->inblock;
+  a->usage.oublock += u->oublock;
+  intr_set_level (old_level);
+}
+
+/* Returns the table entry for program NAME, claiming an unused
+   entry if there is none yet.  Interrupts must be off. */
+static struct acct *
+acct_find (const char *name)
+{
+  struct acct *a;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (a = acct_table; a < acct_table + ACCT_CNT - 1; a++)
+    if (a->name[0] == '\0')
+      {
+        strlcpy (a->name, name, sizeof a->name);
+        return a;
+      }
+    else if (!strcmp (a->name, name))
+      return a;
+
+  /* Table full. */
+  strlcpy (a->name, "(other)", sizeof a->name);
+  return a;
+}
+
+/* Prints the per-program totals. */
+void
+acct_print_stats (void)
+{
+  struct acct *a;
+
+  if (acct_table[0].name[0] == '\0')
+    return;
+
+  printf ("Accounting: program runs utime stime maxrss ptpages heap "
+          "minflt majflt syscalls inblock oublock\n");
+  for (a = acct_table; a < acct_table + ACCT_CNT && a->name[0] != '\0';
+       a++)
+    printf ("  %-15s %d %lld %lld %lu %lu %lu %lu %lu %lu %lu %lu\n",
+            a->name, a->runs, a->usage.utime, a->usage.stime,
+            a->usage.maxrss, a->usage.pt_pages, a->usage.heap_bytes,
+            a->usage.minflt, a->usage.majflt, a->usage.syscalls,
+            a->usage.inblock, a->usage.oublock);
+}
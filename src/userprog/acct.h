@@ -0,0 +1,9 @@
+#ifndef USERPROG_ACCT_H
+#define USERPROG_ACCT_H
+
+struct thread;
+
+void acct_exit (const struct thread *);
+void acct_print_stats (void);
+
+#endif /* userprog/acct.h */
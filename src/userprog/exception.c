@@ -6,6 +6,10 @@
 #include "threads/thread.h"
 #include <user/syscall.h>
 #include "userprog/syscall.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -150,6 +154,23 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in the page if it belongs to the process's address
+     space, or give the process its own copy of a copy-on-write
+     page it writes to.  This also covers kernel accesses to user
+     memory on behalf of system calls. */
+  if (not_present
+      ? page_fault_in (fault_addr,
+                       user ? f->esp : thread_current ()->user_esp)
+      : write && page_fault_cow (fault_addr))
+    return;
+#endif
+
+  /* A kernel access to user memory through one of the routines
+     in userprog/uaccess.c fails gracefully. */
+  if (!user && uaccess_fixup (f))
+    return;
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
@@ -5,6 +5,7 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
@@ -18,21 +19,29 @@ pagedir_create (void)
 {
   uint32_t *pd = palloc_get_page (0);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    {
+      memcpy (pd, init_page_dir, PGSIZE);
+      thread_current ()->usage.pt_pages++;
+    }
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  The pages are freed in batches, so that a large
+   address space does not take the pool locks once per page.
+   PD must not be the active page directory. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
+  struct palloc_batch batch;
   uint32_t *pde;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
+  ASSERT (active_pd () != pd);
+  palloc_batch_init (&batch);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
@@ -41,10 +50,11 @@ pagedir_destroy (uint32_t *pd)
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+            palloc_batch_add (&batch, pte_get_page (*pte));
+        palloc_batch_add (&batch, pt);
       }
-  palloc_free_page (pd);
+  palloc_batch_add (&batch, pd);
+  palloc_batch_flush (&batch);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -75,6 +85,7 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
             return NULL; 
       
           *pde = pde_create (pt);
+          thread_current ()->usage.pt_pages++;
         }
       else
         return NULL;
@@ -214,6 +225,22 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_pagedir (pd);
+    }
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -230,6 +257,14 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Returns true if PD is loaded into the CPU's page directory
+   base register. */
+bool
+pagedir_is_active (uint32_t *pd)
+{
+  return active_pd () == pd;
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
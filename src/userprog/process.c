@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/acct.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -19,6 +20,10 @@
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp, char **pointer_fp);
@@ -91,6 +96,120 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* State handed from a process calling fork() to its child. */
+struct fork_info
+  {
+    struct thread *parent;      /* Forking process, blocked meanwhile. */
+    struct intr_frame if_;      /* Parent's user context. */
+  };
+
+static thread_func start_fork NO_RETURN;
+static bool fork_files (struct thread *parent);
+
+/* Starts a new process that is a copy of the current one, which
+   entered the kernel with user context IF_.  The child shares
+   the parent's memory copy-on-write and returns 0 from the
+   system call.  Returns the new process's thread id, or
+   TID_ERROR if the thread cannot be created. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info *info;
+  tid_t tid;
+
+  info = malloc (sizeof *info);
+  if (info == NULL)
+    return TID_ERROR;
+  info->parent = cur;
+  info->if_ = *if_;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, info);
+  if (tid == TID_ERROR)
+    free (info);
+  return tid;
+}
+
+/* A thread function that copies the forking parent's address
+   space and files into a new process and starts it running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success;
+
+  free (info);
+
+  t->pagedir = pagedir_create ();
+  t->heap_start = parent->heap_start;
+  t->heap_brk = parent->heap_brk;
+  success = t->pagedir != NULL && page_table_init ();
+  if (success)
+    {
+      process_activate ();
+      success = fork_files (parent);
+    }
+  success = success && page_table_fork (parent);
+
+  /* Only now may the parent run again. */
+  t->cp->load_status = success ? LOADED : LOADED_FAIL;
+  sema_up (&t->cp->load_sema);
+  if (!success)
+    thread_exit ();
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current thread its own handles on PARENT's
+   executable and open files, with the same descriptor numbers
+   and positions.  Unlike POSIX, file positions are not shared
+   afterward.  Returns false if memory allocation fails. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  if (parent->exe_file != NULL)
+    {
+      t->exe_file = file_reopen (parent->exe_file);
+      if (t->exe_file == NULL)
+        return false;
+      file_deny_write (t->exe_file);
+    }
+
+  for (e = list_begin (&parent->file_list); e != list_end (&parent->file_list);
+       e = list_next (e))
+    {
+      struct file_desc *pfd = list_entry (e, struct file_desc, elem);
+      struct file_desc *fd = malloc (sizeof *fd);
+
+      if (fd == NULL)
+        return false;
+      fd->fp = file_reopen (pfd->fp);
+      fd->dir = pfd->dir != NULL ? dir_reopen (pfd->dir) : NULL;
+      if (fd->fp == NULL || (pfd->dir != NULL && fd->dir == NULL))
+        {
+          file_close (fd->fp);
+          dir_close (fd->dir);
+          free (fd);
+          return false;
+        }
+      file_seek (fd->fp, file_tell (pfd->fp));
+      fd->fd = pfd->fd;
+      list_push_back (&t->file_list, &fd->elem);
+    }
+  t->fd = parent->fd;
+  return true;
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -130,13 +249,30 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
   
-  lock_acquire(&lock_file_sys);
+  /* Unmap the address space first: its text pages, and the
+     frames shared with other processes through the text table,
+     refer to the executable, which must stay open until they
+     are gone. */
+  pd = cur->pagedir;
+  if (pd != NULL) 
+    {
+#ifdef VM
+      mmap_unmap_all ();
+      page_table_destroy ();
+#endif
+      cur->pagedir = NULL;
+      pagedir_activate (NULL);
+      pagedir_destroy (pd);
+      acct_exit (cur);
+    }
+
   close_fd(CLOSE_FILE);
   if (cur->exe_file)
   {
     file_close(cur->exe_file); 
   }
-  lock_release(&lock_file_sys);
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
   remove_all_cp();
   
   if (check_thread(cur->parent))
@@ -144,13 +280,6 @@ process_exit (void)
     cur->cp->exit = 1;
     sema_up(&cur->cp->exit_sema);
   }
-  pd = cur->pagedir;
-  if (pd != NULL) 
-    {
-      cur->pagedir = NULL;
-      pagedir_activate (NULL);
-      pagedir_destroy (pd);
-    }
 }
 
 /* Sets up the CPU for running user code in the current
@@ -161,8 +290,17 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  Loading CR3 flushes the TLB,
+     so it is skipped when the tables are already active.  Kernel
+     threads, which have no page directory of their own and never
+     touch user memory, keep running on whichever user page
+     directory was last active; a process that switches back
+     after one then finds its TLB entries intact.  A process
+     switches to the initial page directory itself before
+     destroying its own, so the page directory left active is
+     never freed. */
+  if (t->pagedir != NULL && !pagedir_is_active (t->pagedir))
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -256,6 +394,10 @@ load (const char *file_name, void (**eip) (void), void **esp, char **pointer_fp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif
   process_activate ();
 
   file = filesys_open (file_name);
@@ -315,7 +457,7 @@ load (const char *file_name, void (**eip) (void), void **esp, char **pointer_fp)
               uint32_t file_page = phdr.p_offset & ~PGMASK;
               uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+              uint32_t read_bytes, zero_bytes, heap_start;
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
@@ -334,6 +476,11 @@ load (const char *file_name, void (**eip) (void), void **esp, char **pointer_fp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+
+              /* The heap starts above the highest segment. */
+              heap_start = mem_page + read_bytes + zero_bytes;
+              if ((uint8_t *) heap_start > t->heap_start)
+                t->heap_start = t->heap_brk = (uint8_t *) heap_start;
             }
           else
             goto done;
@@ -356,7 +503,9 @@ load (const char *file_name, void (**eip) (void), void **esp, char **pointer_fp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -434,6 +583,16 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record the page in the supplemental page table.  It is
+         read in by the page fault handler on first access, or
+         shared with any other process running this executable
+         if it is read-only. */
+      if (page_add_file (upage, file, ofs, page_read_bytes, writable,
+                         &thread_current ()->exe_ra) == NULL)
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -453,6 +612,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -465,9 +625,18 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp, char **pointer_fp, const char *filename) 
 {
-  uint8_t *kpage;
   bool success = false;
   
+#ifdef VM
+  struct page *stack_page = page_add_zero (((uint8_t *) PHYS_BASE) - PGSIZE,
+                                           true);
+  success = stack_page != NULL && page_load (stack_page);
+  if (!success)
+    return success;
+  *esp = PHYS_BASE;
+#else
+  uint8_t *kpage;
+  
   kpage = palloc_get_page(PAL_USER | PAL_ZERO);
   
   if (kpage != NULL){
@@ -478,6 +647,7 @@ setup_stack (void **esp, char **pointer_fp, const char *filename)
     palloc_free_page(kpage);
     return success;
   }
+#endif
   const int DEFAULT_ARGV = 2;
   char* token;
   char** argv = malloc(DEFAULT_ARGV*sizeof(char*));
@@ -539,7 +709,7 @@ setup_stack (void **esp, char **pointer_fp, const char *filename)
   return success;
 }
 
-
+#ifndef VM
 static bool
 install_page (void *upage, void *kpage, bool writable)
 {
@@ -547,6 +717,120 @@ install_page (void *upage, void *kpage, bool writable)
 
   /* Verify that there's not already a page at that virtual
      address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
-}
\ No newline at end of file
+  if (pagedir_get_page (t->pagedir, upage) != NULL
+      || !pagedir_set_page (t->pagedir, upage, kpage, writable))
+    return false;
+  if (++t->usage.rss > t->usage.maxrss)
+    t->usage.maxrss = t->usage.rss;
+  return true;
+}
+#endif
+
+/* Heap management. */
+
+/* Returns the lowest address of the region reserved for the
+   user stack, which the heap may not grow into. */
+static uint8_t *
+heap_limit (void)
+{
+#ifdef VM
+  size_t stack_pages = stack_page_limit;
+#else
+  size_t stack_pages = 1;
+#endif
+  size_t max_pages = pg_no (PHYS_BASE) - pg_no (USER_VADDR_BOTTOM);
+
+  if (stack_pages > max_pages)
+    stack_pages = max_pages;
+  return (uint8_t *) PHYS_BASE - stack_pages * PGSIZE;
+}
+
+/* Removes the heap pages from START up to END from the current
+   process's address space. */
+static void
+heap_release (uint8_t *start, uint8_t *end)
+{
+  uint8_t *upage;
+
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+#ifdef VM
+      struct page *p = page_lookup (upage);
+      if (p != NULL)
+        page_remove (p);
+#else
+      struct thread *t = thread_current ();
+      void *kpage = pagedir_get_page (t->pagedir, upage);
+      if (kpage != NULL)
+        {
+          pagedir_clear_page (t->pagedir, upage);
+          palloc_free_page (kpage);
+          t->usage.rss--;
+        }
+#endif
+    }
+}
+
+/* Adds zeroed, writable heap pages from START up to END to the
+   current process's address space.  Returns false, adding
+   nothing, if any of the pages is already in use or memory is
+   short. */
+static bool
+heap_extend (uint8_t *start, uint8_t *end)
+{
+  uint8_t *upage;
+
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+#ifdef VM
+      /* Heap pages are allocated and zeroed on first touch. */
+      if (page_lookup (upage) != NULL || page_add_zero (upage, true) == NULL)
+        break;
+#else
+      uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (kpage == NULL)
+        break;
+      if (!install_page (upage, kpage, true))
+        {
+          palloc_free_page (kpage);
+          break;
+        }
+#endif
+    }
+  if (upage < end)
+    {
+      heap_release (start, upage);
+      return false;
+    }
+  return true;
+}
+
+/* Moves the current process's heap break up or down by
+   INCREMENT bytes.  Returns the previous break, or (void *) -1
+   if the heap would shrink below its start, grow into the stack
+   or a memory mapping, or memory is short.  Pages are added and
+   removed only as the break crosses page boundaries. */
+void *
+process_sbrk (intptr_t increment)
+{
+  struct thread *t = thread_current ();
+  uint8_t *old_brk = t->heap_brk;
+  uintptr_t new_brk = (uintptr_t) old_brk + increment;
+  uint8_t *old_end = pg_round_up (old_brk);
+  uint8_t *new_end;
+
+  if (t->heap_start == NULL)
+    return (void *) -1;
+  if (increment >= 0
+      ? new_brk < (uintptr_t) old_brk || new_brk > (uintptr_t) heap_limit ()
+      : new_brk > (uintptr_t) old_brk || new_brk < (uintptr_t) t->heap_start)
+    return (void *) -1;
+
+  new_end = pg_round_up ((void *) new_brk);
+  if (new_end > old_end && !heap_extend (old_end, new_end))
+    return (void *) -1;
+  if (new_end < old_end)
+    heap_release (new_end, old_end);
+  t->heap_brk = (uint8_t *) new_brk;
+  return old_brk;
+}
@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -7,11 +8,19 @@
 #include "pagedir.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define max_arg 3
 
@@ -30,13 +39,20 @@ int write (int fd, const void *buffer, unsigned size);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd); 
-
-bool is_valid_ptr(const void *vaddr);
-void is_valid_str (const void *str);
-bool is_valid_buffer (const void *buf, unsigned byte_size);
-
-bool file_lock = false;
-
+bool chdir (const char *dir);
+bool mkdir (const char *dir);
+bool readdir (int fd, char *name);
+bool isdir (int fd);
+int inumber (int fd);
+#ifdef VM
+mapid_t mmap (int fd, void *addr);
+void munmap (mapid_t mapping);
+tid_t sys_fork (struct intr_frame *f);
+#endif
+bool getrusage (struct rusage *usage);
+void *sbrk (intptr_t increment);
+
+static char *copy_in_string (const char *ustr);
 
 int add_file (struct file *file_name) {
   struct thread *cur_thread = thread_current();
@@ -46,48 +62,76 @@ int add_file (struct file *file_name) {
     return ERROR;
   }
   a -> fp = file_name;
+  a -> dir = NULL;
+  if (inode_is_dir(file_get_inode(file_name)))
+  {
+    /* readdir() goes through a struct dir, which keeps its own position */
+    a -> dir = dir_open(inode_reopen(file_get_inode(file_name)));
+    if (!a -> dir)
+    {
+      free(a);
+      return ERROR;
+    }
+  }
   a -> fd = cur_thread -> fd++;
   list_push_back (&cur_thread -> file_list, &a -> elem);
   return a ->fd; 
 }
 
+/* Fetches the system call's arguments from the user stack,
+   killing the process if they are not all in user memory. */
 void get_arg (struct intr_frame *f, int *args, int num_of_args){
-  int i;
-  int *ptr;
-  for (i = 0; i < num_of_args; i++)
-  {
-    ptr = (int *) f -> esp + i + 1;
-    is_valid_ptr ((const void*) ptr);
-    args[i] = *ptr;
-  }
+  if (!copy_from_user (args, (int *) f -> esp + 1,
+                       num_of_args * sizeof *args))
+    sys_exit(ERROR);
 }
 
-/*Checks if the user address is valid*/
-bool is_valid_ptr (const void * vaddr) {
-      return vaddr != NULL && is_user_vaddr(vaddr) && pagedir_get_page(thread_current()->pagedir, vaddr) != NULL;
+/* Copies user string USTR into a new page, which the caller must
+   free with palloc_free_page().  Kills the process if USTR is
+   not valid user memory.  Returns a null pointer if USTR does not
+   fit in a page or no page is available. */
+static char *copy_in_string (const char *ustr) {
+  char *kstr = palloc_get_page (0);
+  if (!kstr)
+  {
+    return NULL;
+  }
+  int len = strncpy_from_user (kstr, ustr, PGSIZE);
+  if (len < 0)
+  {
+    palloc_free_page (kstr);
+    sys_exit(ERROR);
+  }
+  if (len == PGSIZE)
+  {
+    palloc_free_page (kstr);
+    return NULL;
+  }
+  return kstr;
 }
 
-/*Calls exit with -1 status*/
-void is_valid_str (const void *str) {
-    is_valid_ptr(str);
-}
+/*Return file * equivalent to file descriptor */
+struct file* get_file (int fd) {
+    struct thread *cur = thread_current();
+    struct list_elem *e;
 
-bool is_valid_buffer (const void *buf, unsigned byte_size) {
-    if (!is_valid_ptr(buf)) {
-        return false;
+    for (e = list_begin(&cur->file_list); e != list_end(&cur->file_list); e = list_next(e)) {
+        struct file_desc *fd_elem = list_entry(e, struct file_desc, elem);
+        if (fd_elem->fd == fd)
+            return fd_elem -> fp;
     }
-    return true;
+    return NULL;
 }
 
-/*Return file * equivalent to file descriptor */
-struct file* get_file (int fd) {
+/*Return dir * equivalent to file descriptor, or NULL if it is not a directory */
+struct dir* get_dir (int fd) {
     struct thread *cur = thread_current();
     struct list_elem *e;
 
     for (e = list_begin(&cur->file_list); e != list_end(&cur->file_list); e = list_next(e)) {
         struct file_desc *fd_elem = list_entry(e, struct file_desc, elem);
         if (fd_elem->fd == fd)
-            return fd_elem -> fp;
+            return fd_elem -> dir;
     }
     return NULL;
 }
@@ -101,20 +145,14 @@ syscall_init (void)
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
-  if (!file_lock)
-  {
-    lock_init (&lock_file_sys);
-    file_lock = true;
-  }
-
   int arg [max_arg];
-  int esp = pointer_page ((const void *) f -> esp);
-  if (esp == -1) {
-    f -> eax = ERROR;
-    return;
-  }
-
-  int syscall_number = *(int *)esp;
+#ifdef VM
+  thread_current()->user_esp = f->esp;
+#endif
+  int syscall_number;
+  thread_current()->usage.syscalls++;
+  if (!copy_from_user (&syscall_number, f -> esp, sizeof syscall_number))
+    sys_exit(ERROR);
 
   switch (syscall_number) {
     case SYS_HALT: {
@@ -130,104 +168,131 @@ syscall_handler (struct intr_frame *f UNUSED)
 
     case SYS_EXEC: {
       get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
-      is_valid_str((const void *)arg[0]);
-      arg[0] = (int)pointer_page((const void *)arg[0]);
       f->eax = exec((const char *)arg[0]);
       break;
     }
 
     case SYS_WAIT: {
       get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
       f->eax = wait(arg[0]);
       break;
     }
 
     case SYS_CREATE: {
       get_arg(f, &arg[0], 2);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
-      is_valid_str((const void *)arg[0]);
-      arg[0] = (int)pointer_page((const void *)arg[0]);
       f->eax = create((const char *)arg[0], (unsigned)arg[1]);
       break;
     }
 
     case SYS_REMOVE: {
       get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
-      is_valid_str((const void *)arg[0]);
-      arg[0] = (int)pointer_page((const void *)arg[0]);
       f->eax = remove((const char *)arg[0]);
       break;
     }
 
     case SYS_OPEN: {
      get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
-      is_valid_str((const void *)arg[0]);
-      arg[0] = (int)pointer_page((const void *)arg[0]);
       f->eax = open((const char *)arg[0]);
       break;
     }
 
     case SYS_FILESIZE: {
       get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
       f->eax = filesize(arg[0]);
       break;
     }
 
     case SYS_READ: {
      get_arg(f, &arg[0], 3);
-      if (!is_valid_ptr((const void *)arg[1]))
-        sys_exit(ERROR);
-      is_valid_buffer((const void *)arg[1], (unsigned)arg[2]);
-      arg[1] = (int)pointer_page((const void *)arg[1]);
       f->eax = read(arg[0], (void *)arg[1], (unsigned)arg[2]);
       break;
     }
 
     case SYS_WRITE: {
       get_arg(f, &arg[0], 3);
-      if (!is_valid_ptr((const void *)arg[1]))
-        sys_exit(ERROR);
-      is_valid_buffer((const void *)arg[1], (unsigned)arg[2]);
-      arg[1] = (int)pointer_page((const void *)arg[1]);
       f->eax = write(arg[0], (const void *)arg[1], (unsigned)arg[2]);
       break;
     }
 
     case SYS_SEEK: {
       get_arg(f, &arg[0], 2);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
       seek(arg[0], (unsigned)arg[1]);
       break;
     }
 
     case SYS_TELL: {
       get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
       f->eax = tell(arg[0]);
       break;
     }
 
     case SYS_CLOSE: {
       get_arg(f, &arg[0], 1);
-      if (!is_valid_ptr((const void *)arg[0]))
-        sys_exit(ERROR);
       close(arg[0]);
       break;
     }
 
+    case SYS_CHDIR: {
+      get_arg(f, &arg[0], 1);
+      f->eax = chdir((const char *)arg[0]);
+      break;
+    }
+
+    case SYS_MKDIR: {
+      get_arg(f, &arg[0], 1);
+      f->eax = mkdir((const char *)arg[0]);
+      break;
+    }
+
+    case SYS_READDIR: {
+      get_arg(f, &arg[0], 2);
+      f->eax = readdir(arg[0], (char *)arg[1]);
+      break;
+    }
+
+    case SYS_ISDIR: {
+      get_arg(f, &arg[0], 1);
+      f->eax = isdir(arg[0]);
+      break;
+    }
+
+    case SYS_INUMBER: {
+      get_arg(f, &arg[0], 1);
+      f->eax = inumber(arg[0]);
+      break;
+    }
+
+#ifdef VM
+    case SYS_MMAP: {
+      get_arg(f, &arg[0], 2);
+      f->eax = mmap(arg[0], (void *)arg[1]);
+      break;
+    }
+
+    case SYS_MUNMAP: {
+      get_arg(f, &arg[0], 1);
+      munmap(arg[0]);
+      break;
+    }
+
+    case SYS_FORK: {
+      f->eax = sys_fork(f);
+      break;
+    }
+#endif
+
+    case SYS_GETRUSAGE: {
+      get_arg(f, &arg[0], 1);
+      f->eax = getrusage((struct rusage *)arg[0]);
+      break;
+    }
+
+    case SYS_SBRK: {
+      get_arg(f, &arg[0], 1);
+      f->eax = (uint32_t) sbrk(arg[0]);
+      break;
+    }
+
     default:
       break;
   }
@@ -254,7 +319,13 @@ void sys_exit (int status) {
 }
 
 tid_t exec (const char *cmd_line) {
-    tid_t tid = process_execute(cmd_line);
+    char *kcmd_line = copy_in_string(cmd_line);
+    if (!kcmd_line)
+    {
+      return ERROR;
+    }
+    tid_t tid = process_execute(kcmd_line);
+    palloc_free_page(kcmd_line);
     struct child_process *cp_pointer = find_cp(tid);
     if (!cp_pointer)
     {
@@ -280,73 +351,109 @@ int wait(tid_t id ) {
 }
 
 bool create (const char *file, unsigned initial_size){
-  lock_acquire(&lock_file_sys);
-  bool new = filesys_create(file, initial_size); // from filesys.h
-  lock_release(&lock_file_sys);
+  char *kfile = copy_in_string(file);
+  if (!kfile)
+  {
+    return false;
+  }
+  bool new = filesys_create(kfile, initial_size); // from filesys.h
+  palloc_free_page(kfile);
   return new;
 }
 
 bool remove (const char *file) {
-  lock_acquire(&lock_file_sys);
-  bool new = filesys_remove(file); // from filesys.h
-  lock_release(&lock_file_sys);
+  char *kfile = copy_in_string(file);
+  if (!kfile)
+  {
+    return false;
+  }
+  bool new = filesys_remove(kfile); // from filesys.h
+  palloc_free_page(kfile);
   return new;
 }
 
 int open (const char *file){
-  lock_acquire(&lock_file_sys);
-  struct file *f_pointer = filesys_open(file); // from filesys.h
+  char *kfile = copy_in_string(file);
+  if (!kfile)
+  {
+    return ERROR;
+  }
+  struct file *f_pointer = filesys_open(kfile); // from filesys.h
+  palloc_free_page(kfile);
   if (!f_pointer)
   {
-    lock_release(&lock_file_sys);
     return ERROR;
   }
   int filedes = add_file(f_pointer);
-  lock_release(&lock_file_sys);
+  if (filedes == ERROR)
+  {
+    file_close(f_pointer);
+  }
   return filedes;
 }
 
 int filesize (int fd) {
-  lock_acquire(&lock_file_sys);
   struct file *f_pointer = get_file(fd);
   if (!f_pointer)
   {
-    lock_release(&lock_file_sys);
     return ERROR;
   }
   int filesize = file_length(f_pointer); // from file.h
-  lock_release(&lock_file_sys);
   return filesize;
 }
 
 #define SYSINPUT 0
 #define SYSOUTPUT 1
 
+/* User buffers are moved through a kernel page in chunks, so
+   that the file system never touches user memory and no page
+   fault can happen while a file system lock is held. */
+
 int read(int fd, void *buffer, unsigned size){
   if (size <= 0)
   {
     return size;
   }
-  
-  if (fd == SYSINPUT)
+  uint8_t *kbuf = palloc_get_page(0);
+  if (!kbuf)
+  {
+    return ERROR;
+  }
+  int bytes_read = 0;
+  while ((unsigned) bytes_read < size)
   {
-    unsigned i = 0;
-    uint8_t *local_buf = (uint8_t *) buffer;
-    for (;i < size; i++)
+    unsigned chunk = size - bytes_read < PGSIZE ? size - bytes_read : PGSIZE;
+    int bytes = chunk;
+    if (fd == SYSINPUT)
     {
-      local_buf[i] = input_getc(); // from input.h
+      unsigned i = 0;
+      for (;i < chunk; i++)
+      {
+        kbuf[i] = input_getc(); // from input.h
+      }
     }
-    return size;
-}
-  lock_acquire(&lock_file_sys);
-  struct file *f_pointer = get_file(fd);
-  if (!f_pointer)
-  {
-    lock_release(&lock_file_sys);
-    return ERROR;
+    else
+    {
+      struct file *f_pointer = get_file(fd);
+      bytes = ERROR;
+      if (f_pointer && !get_dir(fd))
+        bytes = file_read(f_pointer, kbuf, chunk); // from file.h
+      if (bytes == ERROR)
+      {
+        bytes_read = ERROR;
+        break;
+      }
+    }
+    if (!copy_to_user((uint8_t *) buffer + bytes_read, kbuf, bytes))
+    {
+      palloc_free_page(kbuf);
+      sys_exit(ERROR);
+    }
+    bytes_read += bytes;
+    if ((unsigned) bytes < chunk)
+      break;
   }
-  int bytes_read = file_read(f_pointer, buffer, size); // from file.h
-  lock_release (&lock_file_sys);
+  palloc_free_page(kbuf);
   return bytes_read;
 }
 
@@ -356,60 +463,167 @@ int write (int fd, const void *buffer, unsigned size){
     {
       return size;
     }
-    if (fd == SYSOUTPUT)
+    uint8_t *kbuf = palloc_get_page(0);
+    if (!kbuf)
     {
-      putbuf (buffer, size); // from stdio.h
-      return size;
+      return ERROR;
     }
-    lock_acquire(&lock_file_sys);
-    struct file *f_pointer = get_file(fd);
-    if (!f_pointer)
+    int bytes_written = 0;
+    while ((unsigned) bytes_written < size)
     {
-      lock_release(&lock_file_sys);
-      return ERROR;
+      unsigned chunk = size - bytes_written < PGSIZE ? size - bytes_written : PGSIZE;
+      int bytes = chunk;
+      if (!copy_from_user(kbuf, (const uint8_t *) buffer + bytes_written, chunk))
+      {
+        palloc_free_page(kbuf);
+        sys_exit(ERROR);
+      }
+      if (fd == SYSOUTPUT)
+      {
+        putbuf ((const char *) kbuf, chunk); // from stdio.h
+      }
+      else
+      {
+        struct file *f_pointer = get_file(fd);
+        bytes = ERROR;
+        if (f_pointer && !get_dir(fd))
+          bytes = file_write(f_pointer, kbuf, chunk); // file.h
+        if (bytes == ERROR)
+        {
+          bytes_written = ERROR;
+          break;
+        }
+      }
+      bytes_written += bytes;
+      if ((unsigned) bytes < chunk)
+        break;
     }
-    int bytes_written = file_write(f_pointer, buffer, size); // file.h
-    lock_release (&lock_file_sys);
+    palloc_free_page(kbuf);
     return bytes_written;
 }
 
 void seek (int fd, unsigned position){
-  lock_acquire(&lock_file_sys);
   struct file *f_pointer = get_file(fd);
   if (!f_pointer)
   {
-    lock_release(&lock_file_sys);
     return;
   }
   file_seek(f_pointer, position);
-  lock_release(&lock_file_sys);
 }
 
 unsigned tell (int fd) {
-  lock_acquire(&lock_file_sys);
   struct file *f_pointer = get_file(fd);
   if (!f_pointer)
   {
-    lock_release(&lock_file_sys);
     return ERROR;
   }
   off_t offset = file_tell(f_pointer); //from file.h
-  lock_release(&lock_file_sys);
   return offset;
 }
 
 void close (int fd) {
-  lock_acquire(&lock_file_sys);
   close_fd(fd);
-  lock_release(&lock_file_sys);
 }
 
-int pointer_page (const void *vaddr){
-    if (is_valid_ptr(vaddr)) {
-        return (int)vaddr;
-    } else {
-        return -1;
+bool chdir (const char *dir) {
+  char *kdir = copy_in_string(dir);
+  if (!kdir)
+  {
+    return false;
+  }
+  bool success = filesys_chdir(kdir); // from filesys.h
+  palloc_free_page(kdir);
+  return success;
+}
+
+bool mkdir (const char *dir) {
+  char *kdir = copy_in_string(dir);
+  if (!kdir)
+  {
+    return false;
+  }
+  bool success = filesys_mkdir(kdir); // from filesys.h
+  palloc_free_page(kdir);
+  return success;
+}
+
+/* Copies the next entry of directory FD, other than "." and "..",
+   to NAME, which must have room for NAME_MAX + 1 bytes. */
+bool readdir (int fd, char *name) {
+  char kname[NAME_MAX + 1];
+  struct dir *d_pointer = get_dir(fd);
+  bool success = d_pointer && dir_readdir(d_pointer, kname); // from directory.h
+  if (success && !copy_to_user(name, kname, strlen(kname) + 1))
+  {
+    sys_exit(ERROR);
+  }
+  return success;
+}
+
+bool isdir (int fd) {
+  bool is_dir = get_dir(fd) != NULL;
+  return is_dir;
+}
+
+int inumber (int fd) {
+  struct file *f_pointer = get_file(fd);
+  if (!f_pointer)
+  {
+    return ERROR;
+  }
+  int inumber = inode_get_inumber(file_get_inode(f_pointer)); // from inode.h
+  return inumber;
+}
+
+#ifdef VM
+mapid_t mmap (int fd, void *addr) {
+  struct file *f_pointer = get_file(fd);
+  /* The mapping gets its own file, independent of FD. */
+  struct file *file = f_pointer && !get_dir(fd) ? file_reopen(f_pointer) : NULL;
+  if (!file)
+  {
+    return MAP_FAILED;
+  }
+  return mmap_map(file, addr);
+}
+
+void munmap (mapid_t mapping) {
+  mmap_unmap(mapping);
+}
+
+tid_t sys_fork (struct intr_frame *f) {
+    tid_t tid = process_fork(f);
+    struct child_process *cp_pointer = find_cp(tid);
+    if (!cp_pointer)
+    {
+      return ERROR;
+    }
+    /* wait until the child has copied our address space */
+    if (cp_pointer->load_status == UNLOADED)
+    {
+      sema_down(&cp_pointer->load_sema);
     }
+    /* check if the copy failed */
+    if (cp_pointer->load_status == LOADED_FAIL)
+    {
+      remove_cp(cp_pointer);
+      return ERROR;
+    }
+    return tid;
+}
+#endif
+
+/* Copies the calling process's resource usage to USAGE. */
+bool getrusage (struct rusage *usage) {
+  if (!copy_to_user(usage, &thread_current()->usage, sizeof *usage))
+    sys_exit(ERROR);
+  return true;
+}
+
+/* Moves the heap break by INCREMENT bytes and returns the old
+   break, or (void *) -1 on failure. */
+void *sbrk (intptr_t increment) {
+  return process_sbrk(increment);
 }
 
 struct child_process* find_cp(int pid)
@@ -467,6 +681,7 @@ close_fd (int file_descriptor)
     if (file_descriptor == p->fd || file_descriptor == CLOSE_FILE)
     {
       file_close(p->fp);
+      dir_close(p->dir);
       list_remove(&p->elem);
       free(p);
       if (file_descriptor != CLOSE_FILE)
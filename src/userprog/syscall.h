@@ -12,10 +12,9 @@ void syscall_init (void);
 #define USER_VADDR_BOTTOM ((void *) 0x08048000)
 
 
-struct lock lock_file_sys;
-
 struct file_desc{
     struct file *fp;
+    struct dir *dir;            /* also open as a directory, if it is one */
     int fd;
     struct list_elem elem;
 };
@@ -31,11 +30,11 @@ struct child_process {
   struct list_elem elem;
 };
 
-int pointer_page (const void *vaddr);
 struct child_process* find_cp (int pid);
 void remove_cp (struct child_process *child);
 void remove_all_cp (void);
 struct file* get_file(int fd);
+struct dir* get_dir(int fd);
 void close_fd (int file_descriptor);
 void sys_exit (int status);
 
@@ -0,0 +1,134 @@
+#include "userprog/uaccess.h"
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Access to user memory from the kernel.
+
+   Rather than checking every user pointer against the page
+   table before using it, these routines simply dereference user
+   addresses, after making sure that they lie below PHYS_BASE.
+   If an access faults and the page fault handler cannot resolve
+   it, the handler looks up the faulting instruction in the
+   exception table and, if it is there, resumes execution at the
+   corresponding fixup address instead of killing the kernel.
+   The fixup code then reports the failure to its caller.
+
+   Each instruction that may fault on a user address adds an
+   entry to the table by emitting it into the __ex_table
+   section, which the linker script gathers between
+   _start_ex_table and _end_ex_table. */
+
+/* An exception table entry. */
+struct exception_entry
+  {
+    uintptr_t insn;             /* Address of faulting instruction. */
+    uintptr_t fixup;            /* Where to continue after a fault. */
+  };
+
+/* Exception table, from the linker script. */
+extern const struct exception_entry _start_ex_table[], _end_ex_table[];
+
+/* Returns true if the SIZE bytes starting at UADDR all lie in
+   user space. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  uintptr_t end = start + size;
+
+  return end >= start && end <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from SRC to DST, either of which may be a
+   user address.  Returns the number of bytes not copied because
+   of a fault, which is 0 on success. */
+static size_t
+copy_user (void *dst, const void *src, size_t size)
+{
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                ".pushsection __ex_table, \"a\"\n"
+                ".long 1b, 2b\n"
+                ".popsection"
+                : "+c" (size), "+D" (dst), "+S" (src)
+                : : "memory");
+  return size;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if any part of the
+   source is not valid user memory. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && copy_user (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if any part of the
+   destination is not valid, writable user memory. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && copy_user (udst, src, size) == 0;
+}
+
+/* Reads the byte at user address USRC into *DST.  Returns true
+   if successful, false if the read faulted. */
+static inline bool
+get_user (char *dst, const char *usrc)
+{
+  int ok, byte;
+
+  asm volatile ("movl $0, %0\n"
+                "1: movzbl %2, %1\n"
+                "movl $1, %0\n"
+                "2:\n"
+                ".pushsection __ex_table, \"a\"\n"
+                ".long 1b, 2b\n"
+                ".popsection"
+                : "=&r" (ok), "=&r" (byte) : "m" (*usrc));
+  *dst = byte;
+  return ok;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes including the null
+   terminator.  Returns the length of the string, not counting
+   the null terminator, or -1 if the string runs into memory that
+   is not valid user memory.  If the string does not fit, returns
+   SIZE, and DST is not null-terminated. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      if (!is_user_vaddr (usrc + i) || !get_user (&dst[i], usrc + i))
+        return -1;
+      if (dst[i] == '\0')
+        return i;
+    }
+  return size;
+}
+
+/* Called by the page fault handler for a fault in kernel mode
+   that it could not otherwise resolve.  If the faulting
+   instruction is in the exception table, redirects F to resume
+   at its fixup address and returns true.  Otherwise, returns
+   false. */
+bool
+uaccess_fixup (struct intr_frame *f)
+{
+  const struct exception_entry *e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        return true;
+      }
+  return false;
+}
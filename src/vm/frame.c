@@ -0,0 +1,473 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.  Every frame handed out from the user pool is
+   recorded here together with the pages that map it.  When the
+   user pool runs dry, a victim is chosen with the second-chance
+   ("clock") algorithm: the hand sweeps the table, clearing
+   accessed bits as it goes, and evicts the first unpinned frame
+   that none of its pages has accessed since the hand last
+   passed it.
+
+   A frame is freed as soon as it is neither mapped by any page
+   nor pinned.
+
+   Frames holding read-only pages of an executable are also
+   entered in a text table keyed by inode and file offset, so
+   that every process running the same program maps the same
+   copy of its code.  Each such frame holds a reference to its
+   inode, so that the inode cannot be freed and its address
+   reused by another executable while the frame is in the
+   table.  Every process that maps a text frame also has the
+   executable open until it has unmapped all its pages, so the
+   frame's reference is never the last one, and dropping it
+   never does I/O while the frame lock is held.
+
+   So that page faults rarely have to wait for an eviction, a
+   reclaim thread is woken whenever an allocation leaves fewer
+   than low_water pages free in the user pool.  It evicts frames
+   with the same clock algorithm, RECLAIM_BATCH at a time,
+   until high_water pages are free.  It stops early once the
+   swap device is full, leaving any eviction that might fail for
+   lack of swap space to the allocation that needs it. */
+
+/* Frames evicted per frame lock hold by the reclaim thread. */
+#define RECLAIM_BATCH 8
+
+static struct list frame_table;     /* All frames in use. */
+static struct lock frame_lock;      /* Protects frame_table, frames. */
+static struct list_elem *clock_hand;  /* Next frame the clock visits. */
+static struct hash text_frames;     /* Shared text frames. */
+static struct condition frame_cond; /* See frame_lock_wait(). */
+
+/* Reclaim thread. */
+static struct condition reclaim_cond; /* Signaled when memory is low. */
+static size_t low_water;            /* Wake reclaim below this. */
+static size_t high_water;           /* Reclaim up to this. */
+
+/* Statistics. */
+static long long reclaimed_cnt;     /* Frames freed by reclaim thread. */
+static long long evicted_cnt;       /* Frames evicted by allocations. */
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+
+static struct frame *frame_get (enum palloc_flags, struct page *,
+                                bool evict);
+static struct frame *frame_evict (void);
+static void frame_free (struct frame *, struct palloc_batch *);
+static void frame_forget_text (struct frame *);
+static thread_func reclaim_thread;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_table);
+  lock_init (&frame_lock);
+  cond_init (&frame_cond);
+  clock_hand = NULL;
+  if (!hash_init (&text_frames, text_hash, text_less, NULL))
+    PANIC ("frame: text table creation failed");
+
+  /* The whole user pool is free at this point. */
+  cond_init (&reclaim_cond);
+  low_water = palloc_free_pages (PAL_USER) / 32 + 1;
+  high_water = 2 * low_water;
+}
+
+/* Starts the reclaim thread.  Must be called once the thread
+   system and swap are up. */
+void
+frame_start_reclaim (void)
+{
+  thread_create ("reclaim", PRI_DEFAULT, reclaim_thread, NULL);
+}
+
+/* Obtains a frame from the user pool, evicting another page if
+   the pool is empty, and attaches PAGE to it if PAGE is
+   non-null.  If PAL_ZERO is set in FLAGS, the frame is zeroed.
+   The frame is returned pinned; the caller unpins it once its
+   contents are in place.  Returns a null pointer if no frame
+   could be obtained. */
+struct frame *
+frame_alloc (enum palloc_flags flags, struct page *page)
+{
+  return frame_get (flags, page, true);
+}
+
+/* Like frame_alloc(), but fails instead of evicting a page if
+   the user pool is empty.  For speculative uses such as read
+   ahead, which should not push out pages in use. */
+struct frame *
+frame_try_alloc (enum palloc_flags flags, struct page *page)
+{
+  return frame_get (flags, page, false);
+}
+
+/* Implements frame_alloc() and frame_try_alloc().  Evicts a page
+   if the user pool is empty only if EVICT is true. */
+static struct frame *
+frame_get (enum palloc_flags flags, struct page *page, bool evict)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_page (PAL_USER | flags);
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          lock_release (&frame_lock);
+          return NULL;
+        }
+      f->kpage = kpage;
+      list_init (&f->pages);
+      f->pin_cnt = 1;
+      f->inode = NULL;
+      list_push_back (&frame_table, &f->elem);
+    }
+  else
+    {
+      f = evict ? frame_evict () : NULL;
+      if (f == NULL)
+        {
+          lock_release (&frame_lock);
+          return NULL;
+        }
+      evicted_cnt++;
+      if (flags & PAL_ZERO)
+        memset (f->kpage, 0, PGSIZE);
+    }
+  if (page != NULL)
+    frame_attach (f, page);
+  if (palloc_free_pages (PAL_USER) < low_water)
+    cond_signal (&reclaim_cond, &frame_lock);
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Removes F from the frame table and returns its memory to the
+   user pool, or adds it to BATCH if BATCH is nonnull. */
+static void
+frame_free (struct frame *f, struct palloc_batch *batch)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (list_empty (&f->pages) && f->pin_cnt == 0);
+
+  frame_forget_text (f);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  if (batch != NULL)
+    palloc_batch_add (batch, f->kpage);
+  else
+    palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Records that PAGE maps F.  The caller must hold the frame
+   lock. */
+void
+frame_attach (struct frame *f, struct page *page)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (page->frame == NULL);
+
+  list_push_back (&f->pages, &page->frame_elem);
+  page->frame = f;
+  if (++page->thread->usage.rss > page->thread->usage.maxrss)
+    page->thread->usage.maxrss = page->thread->usage.rss;
+}
+
+/* Detaches PAGE from its frame, which is freed if no other page
+   maps it and it is not pinned.  If BATCH is nonnull, the
+   frame's memory is added to it instead of being freed at once.
+   The caller must hold the frame lock and must already have
+   unmapped PAGE. */
+void
+frame_detach (struct page *page, struct palloc_batch *batch)
+{
+  struct frame *f = page->frame;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (f != NULL);
+
+  list_remove (&page->frame_elem);
+  page->frame = NULL;
+  page->thread->usage.rss--;
+  if (list_empty (&f->pages) && f->pin_cnt == 0)
+    frame_free (f, batch);
+}
+
+/* Returns true if more than one page maps F. */
+bool
+frame_is_shared (struct frame *f)
+{
+  return !list_empty (&f->pages)
+         && list_begin (&f->pages) != list_rbegin (&f->pages);
+}
+
+/* Returns the frame holding the text page of INODE whose first
+   BYTES bytes come from offset OFS, or a null pointer if no
+   process has it in memory.  The caller must hold the frame
+   lock. */
+struct frame *
+frame_find_text (struct inode *inode, off_t ofs, size_t bytes)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  key.inode = inode;
+  key.text_ofs = ofs;
+  key.text_bytes = bytes;
+  e = hash_find (&text_frames, &key.text_elem);
+  return e != NULL ? hash_entry (e, struct frame, text_elem) : NULL;
+}
+
+/* Enters F, which holds the text page of INODE whose first
+   BYTES bytes come from offset OFS, in the text table so that
+   other processes can share it, and reopens INODE for as long
+   as F is there.  Does nothing if another frame already holds
+   that page.  The caller must hold the frame lock. */
+void
+frame_set_text (struct frame *f, struct inode *inode, off_t ofs,
+                size_t bytes)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (f->inode == NULL);
+
+  f->inode = inode;
+  f->text_ofs = ofs;
+  f->text_bytes = bytes;
+  if (hash_insert (&text_frames, &f->text_elem) != NULL)
+    f->inode = NULL;
+  else
+    inode_reopen (inode);
+}
+
+/* Removes F from the text table, if it is there, and closes its
+   inode. */
+static void
+frame_forget_text (struct frame *f)
+{
+  if (f->inode != NULL)
+    {
+      hash_delete (&text_frames, &f->text_elem);
+      inode_close (f->inode);
+      f->inode = NULL;
+    }
+}
+
+/* Returns a hash value for text frame F. */
+static unsigned
+text_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, text_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->text_ofs);
+}
+
+/* Returns true if text frame A precedes text frame B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, text_elem);
+  const struct frame *b = hash_entry (b_, struct frame, text_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  else if (a->text_ofs != b->text_ofs)
+    return a->text_ofs < b->text_ofs;
+  else
+    return a->text_bytes < b->text_bytes;
+}
+
+/* Pins F so that it is not evicted.  Pins nest.  The caller must
+   hold the frame lock, so that F cannot be chosen as a victim
+   between the caller's lookup and the pin. */
+void
+frame_pin (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  f->pin_cnt++;
+}
+
+/* Drops a pin on F, making it eligible for eviction again once
+   no pins remain, or freeing it if no page maps it.  The caller
+   must hold the frame lock. */
+void
+frame_unpin (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (f->pin_cnt > 0);
+
+  if (--f->pin_cnt == 0 && list_empty (&f->pages))
+    frame_free (f, NULL);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %lld frames reclaimed in background, "
+          "%lld evicted on demand\n", reclaimed_cnt, evicted_cnt);
+}
+
+/* Acquires the frame lock. */
+void
+frame_lock_acquire (void)
+{
+  lock_acquire (&frame_lock);
+}
+
+/* Releases the frame lock. */
+void
+frame_lock_release (void)
+{
+  lock_release (&frame_lock);
+}
+
+/* Releases the frame lock, waits until another thread calls
+   frame_lock_wake(), and reacquires the lock.  The caller must
+   hold the frame lock and recheck what it is waiting for. */
+void
+frame_lock_wait (void)
+{
+  cond_wait (&frame_cond, &frame_lock);
+}
+
+/* Wakes every thread waiting in frame_lock_wait().  The caller
+   must hold the frame lock. */
+void
+frame_lock_wake (void)
+{
+  cond_broadcast (&frame_cond, &frame_lock);
+}
+
+/* Returns the frame under the clock hand and advances the
+   hand, wrapping around at the end of the table. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+    clock_hand = list_begin (&frame_table);
+  f = list_entry (clock_hand, struct frame, elem);
+  clock_hand = list_next (clock_hand);
+  return f;
+}
+
+/* Returns true if any page mapping F has been accessed since
+   the last call, clearing the accessed bits as it goes. */
+static bool
+frame_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->thread->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Chooses a victim frame with the clock algorithm, writes its
+   pages out to backing store and returns the now-free frame,
+   pinned and still in the frame table.  Returns a null pointer
+   if every frame is pinned.  The caller must hold the frame
+   lock, which is released while a memory-mapped page is written
+   back to its file. */
+static struct frame *
+frame_evict (void)
+{
+  size_t sweeps = 2 * list_size (&frame_table);
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (i = 0; i < sweeps; i++)
+    {
+      struct frame *f = clock_next ();
+
+      if (f->pin_cnt > 0)
+        continue;
+      if (frame_accessed (f))
+        continue;               /* Second chance. */
+
+      f->pin_cnt = 1;
+      page_evict (f);
+      frame_forget_text (f);
+      return f;
+    }
+  return NULL;
+}
+
+/* Reclaim thread.  Waits until the user pool runs low, then
+   evicts frames in batches until high_water pages are free,
+   releasing the frame lock between batches so that page faults
+   can proceed. */
+static void
+reclaim_thread (void *aux UNUSED)
+{
+  lock_acquire (&frame_lock);
+  for (;;)
+    {
+      bool progress = true;
+
+      cond_wait (&reclaim_cond, &frame_lock);
+      while (progress && palloc_free_pages (PAL_USER) < high_water)
+        {
+          size_t i;
+
+          for (i = 0; i < RECLAIM_BATCH; i++)
+            {
+              struct frame *f;
+
+              if (palloc_free_pages (PAL_USER) >= high_water
+                  || swap_is_full ())
+                {
+                  progress = false;
+                  break;
+                }
+              f = frame_evict ();
+              if (f == NULL)
+                {
+                  progress = false;
+                  break;
+                }
+              frame_unpin (f);
+              reclaimed_cnt++;
+            }
+
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+    }
+}
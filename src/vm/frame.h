@@ -0,0 +1,53 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+
+struct inode;
+struct page;
+
+/* A physical frame from the user pool holding a user page.
+   After fork() several processes' pages may map the same frame
+   read-only until one of them writes to it. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address of the frame. */
+    struct list pages;          /* Pages mapping the frame. */
+    int pin_cnt;                /* Never chosen for eviction if nonzero. */
+    struct list_elem elem;      /* Element in frame table. */
+
+    /* Read-only executable text, shared by every process running
+       the executable. */
+    struct inode *inode;        /* Executable, or null if not text. */
+    off_t text_ofs;             /* Offset of the text in INODE. */
+    size_t text_bytes;          /* Bytes from INODE; the rest is zero. */
+    struct hash_elem text_elem; /* Element in text table. */
+  };
+
+void frame_init (void);
+void frame_start_reclaim (void);
+struct frame *frame_alloc (enum palloc_flags, struct page *);
+struct frame *frame_try_alloc (enum palloc_flags, struct page *);
+void frame_attach (struct frame *, struct page *);
+void frame_detach (struct page *, struct palloc_batch *);
+bool frame_is_shared (struct frame *);
+struct frame *frame_find_text (struct inode *, off_t ofs, size_t bytes);
+void frame_set_text (struct frame *, struct inode *, off_t ofs,
+                     size_t bytes);
+void frame_pin (struct frame *);
+void frame_unpin (struct frame *);
+
+void frame_print_stats (void);
+
+void frame_lock_acquire (void);
+void frame_lock_release (void);
+void frame_lock_wait (void);
+void frame_lock_wake (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,142 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.  A mapping is a run of PAGE_MMAP pages in
+   the supplemental page table, all backed by one private
+   reopened `struct file', so that closing or removing the file
+   does not affect the mapping.  Pages are read lazily by the
+   page fault handler and only dirty pages are written back. */
+
+static struct mapping *mmap_find (mapid_t);
+static void mmap_remove (struct mapping *);
+
+/* Maps FILE, of which the mapping takes ownership, into the
+   current process's address space starting at ADDR.  Fails if
+   FILE is empty, if ADDR is null or not page-aligned, or if the
+   mapping would overlap any existing page.  Returns the new
+   mapping's identifier, or MAP_FAILED on failure, in which case
+   FILE is closed. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  uint8_t *upage = addr;
+  off_t length;
+  size_t i;
+
+  length = file_length (file);
+
+  m = malloc (sizeof *m);
+  if (m == NULL || length == 0 || upage == NULL || pg_ofs (upage) != 0)
+    goto fail;
+  m->file = file;
+  m->addr = upage;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  m->ra.next = NULL;
+  m->ra.window = 0;
+
+  /* The whole range must lie in user space, below the region
+     reserved for stack growth, and be unused. */
+  if (upage + m->page_cnt * PGSIZE < upage
+      || !is_user_vaddr (upage + m->page_cnt * PGSIZE - 1)
+      || page_is_stack (upage + m->page_cnt * PGSIZE - 1))
+    goto fail;
+  for (i = 0; i < m->page_cnt; i++)
+    if (page_lookup (upage + i * PGSIZE) != NULL)
+      goto fail;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (page_add_mmap (upage + ofs, file, ofs, read_bytes, &m->ra) == NULL)
+        {
+          m->page_cnt = i;
+          mmap_remove (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mmap_list, &m->elem);
+  return m->id;
+
+ fail:
+  free (m);
+  file_close (file);
+  return MAP_FAILED;
+}
+
+/* Unmaps the mapping identified by MAPID, writing back its
+   dirty pages.  Does nothing if there is no such mapping. */
+void
+mmap_unmap (mapid_t mapid)
+{
+  struct mapping *m = mmap_find (mapid);
+
+  if (m != NULL)
+    {
+      list_remove (&m->elem);
+      mmap_remove (m);
+    }
+}
+
+/* Unmaps all of the current process's mappings.  Called at
+   process exit. */
+void
+mmap_unmap_all (void)
+{
+  struct list *mmaps = &thread_current ()->mmap_list;
+
+  while (!list_empty (mmaps))
+    {
+      struct mapping *m = list_entry (list_pop_front (mmaps),
+                                      struct mapping, elem);
+      mmap_remove (m);
+    }
+}
+
+/* Returns the current process's mapping with MAPID, or a null
+   pointer if there is none. */
+static struct mapping *
+mmap_find (mapid_t mapid)
+{
+  struct list *mmaps = &thread_current ()->mmap_list;
+  struct list_elem *e;
+
+  for (e = list_begin (mmaps); e != list_end (mmaps); e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes M's pages from the supplemental page table, writing
+   back dirty ones, then closes M's file and frees M.  M must
+   not be in any list. */
+static void
+mmap_remove (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      struct page *p = page_lookup ((uint8_t *) m->addr + i * PGSIZE);
+      ASSERT (p != NULL && p->type == PAGE_MMAP);
+      page_remove (p);
+    }
+
+  file_close (m->file);
+  free (m);
+}
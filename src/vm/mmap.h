@@ -0,0 +1,29 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stddef.h>
+#include "vm/page.h"
+
+struct file;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A memory-mapped file in a process's address space. */
+struct mapping
+  {
+    mapid_t id;                 /* Map region identifier. */
+    struct file *file;          /* File mapped, owned by the mapping. */
+    void *addr;                 /* First mapped user page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+    struct readahead ra;        /* Read-ahead state. */
+    struct list_elem elem;      /* Element in thread's mmap_list. */
+  };
+
+mapid_t mmap_map (struct file *, void *addr);
+void mmap_unmap (mapid_t);
+void mmap_unmap_all (void);
+
+#endif /* vm/mmap.h */
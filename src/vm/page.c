@@ -0,0 +1,755 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+
+/* Supplemental page table.  Each process keeps a hash table of
+   `struct page', keyed by user virtual address, describing every
+   page of its address space whether or not it is resident.
+   Pages are brought in lazily by the page fault handler and
+   written out again by the frame table's evictor.
+
+   The stack starts out as a single page and grows down one
+   zeroed page at a time, on faults just below the user stack
+   pointer, up to stack_page_limit pages.
+
+   fork() copies the table and shares every resident frame
+   between parent and child, mapped read-only in both.  The
+   first write to such a page faults and is resolved by
+   page_fault_cow(), which gives the writer a private copy.
+
+   A fault on a file-backed page also maps neighbouring
+   executable pages that other processes already hold in
+   memory, and, when faults in a region arrive in sequence,
+   reads ahead a window of following pages that doubles with
+   each sequential fault up to readahead_pages.  Pages read
+   ahead only use free frames; they never cause eviction.
+
+   Writing a dirty memory-mapped page back to its file goes
+   through the file system and the journal, which can block for
+   a long time, so it is done without holding the frame lock.
+   An evicted page is detached from its frame and marked as
+   being written back first, and anything that would bring the
+   page in again or release it waits for the write to finish. */
+
+/* Maximum size of a user stack, in pages. */
+size_t stack_page_limit = STACK_PAGES_DEFAULT;
+
+/* Fault-around block and maximum read-ahead window, in pages. */
+size_t fault_around_pages = FAULT_AROUND_DEFAULT;
+size_t readahead_pages = READAHEAD_DEFAULT;
+
+/* How hard page_in() tries to bring a page in. */
+enum page_in_mode
+  {
+    PAGE_IN_FAULT,              /* Demand fault: evict if necessary. */
+    PAGE_IN_READAHEAD,          /* Read ahead: use free frames only. */
+    PAGE_IN_CACHED              /* Only map a frame already in memory. */
+  };
+
+static struct page *page_add (void *upage, enum page_type, bool writable);
+static struct page *page_grow_stack (const void *uaddr, const void *esp);
+static bool page_in (struct page *, enum page_in_mode);
+static bool page_in_unpinned (struct page *, enum page_in_mode);
+static void page_map_around (struct page *);
+static void page_read_ahead (struct page *);
+static bool page_unshare (struct page *);
+static void page_write_file (struct page *, const void *kpage);
+static void page_wait_writeback (struct page *);
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Initializes the current thread's supplemental page table.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Copies PARENT's supplemental page table into the current
+   thread's, which must be empty, for fork().  Resident frames
+   are shared copy-on-write: both processes map them read-only
+   until one writes.  Swapped-out pages share their swap slot.
+   File pages are re-pointed at the current thread's own handle
+   on the executable and its read-ahead state.  Memory mappings are not inherited.
+   PARENT must be blocked for the duration.  Returns false if
+   memory allocation fails. */
+bool
+page_table_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  bool success = true;
+
+  frame_lock_acquire ();
+  hash_first (&i, &parent->pages);
+  while (success && hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *p;
+
+      if (pp->type == PAGE_MMAP)
+        continue;
+
+      p = page_add (pp->upage, pp->type, pp->writable);
+      if (p == NULL)
+        {
+          success = false;
+          continue;
+        }
+      if (pp->type == PAGE_FILE)
+        p->file = t->exe_file;
+      if (pp->ra != NULL)
+        p->ra = &t->exe_ra;
+      p->file_ofs = pp->file_ofs;
+      p->read_bytes = pp->read_bytes;
+
+      if (pp->frame != NULL)
+        {
+          uint32_t *ppd = parent->pagedir;
+
+          if (!pagedir_set_page (t->pagedir, p->upage, pp->frame->kpage,
+                                 false))
+            success = false;
+          else
+            {
+              if (pp->writable)
+                pagedir_set_writable (ppd, pp->upage, false);
+              if (pagedir_is_dirty (ppd, pp->upage))
+                pagedir_set_dirty (t->pagedir, p->upage, true);
+              frame_attach (pp->frame, p);
+            }
+        }
+      else if (pp->swap_slot != SWAP_ERROR)
+        p->swap_slot = swap_dup (pp->swap_slot);
+    }
+  frame_lock_release ();
+
+  return success;
+}
+
+/* Releases page P's hold on its frame or swap slot, first
+   writing P back to its file if it is a dirty memory-mapped
+   page.  A frame freed as a result is added to BATCH if BATCH
+   is nonnull. */
+static void
+page_release (struct page *p, struct palloc_batch *batch)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+
+  frame_lock_acquire ();
+  page_wait_writeback (p);
+  if (p->frame != NULL)
+    {
+      struct frame *f = p->frame;
+
+      pagedir_clear_page (pd, p->upage);
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (pd, p->upage))
+        {
+          /* The pin keeps F from being evicted while the frame
+             lock is released for the write. */
+          frame_pin (f);
+          frame_lock_release ();
+          page_write_file (p, f->kpage);
+          frame_lock_acquire ();
+          frame_unpin (f);
+        }
+      frame_detach (p, batch);
+    }
+  else if (p->type == PAGE_SWAP && p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  frame_lock_release ();
+}
+
+/* Frees page P, whose resources have already been released. */
+static void
+page_destroy (struct hash_elem *p_, void *aux UNUSED)
+{
+  free (hash_entry (p_, struct page, hash_elem));
+}
+
+/* Destroys the current thread's supplemental page table,
+   releasing every frame and swap slot it uses.  The frames go
+   back to the user pool in batches. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+  struct palloc_batch batch;
+  struct hash_iterator i;
+
+  /* The table may never have been initialized if loading
+     failed early. */
+  if (t->pages.buckets == NULL)
+    return;
+
+  palloc_batch_init (&batch);
+  hash_first (&i, &t->pages);
+  while (hash_next (&i))
+    page_release (hash_entry (hash_cur (&i), struct page, hash_elem),
+                  &batch);
+  palloc_batch_flush (&batch);
+  hash_destroy (&t->pages, page_destroy);
+}
+
+/* Returns the page containing user address UADDR in the current
+   thread's supplemental page table, or a null pointer if there
+   is no such page. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Adds a non-resident page at UPAGE of type TYPE to the current
+   thread's supplemental page table.  Returns the new page, or a
+   null pointer if UPAGE is already in use or memory allocation
+   fails. */
+static struct page *
+page_add (void *upage, enum page_type type, bool writable)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->thread = thread_current ();
+  p->writable = writable;
+  p->type = type;
+  p->frame = NULL;
+  p->writeback = false;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->ra = NULL;
+  p->swap_slot = SWAP_ERROR;
+
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Adds a file-backed page of TYPE at UPAGE whose first
+   READ_BYTES bytes come from FILE at offset OFS, in the region
+   whose read-ahead state is RA. */
+static struct page *
+page_add_backed (void *upage, enum page_type type, struct file *file,
+                 off_t ofs, size_t read_bytes, bool writable,
+                 struct readahead *ra)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, type, writable);
+  if (p != NULL)
+    {
+      p->file = file;
+      p->file_ofs = ofs;
+      p->read_bytes = read_bytes;
+      p->ra = ra;
+    }
+  return p;
+}
+
+/* Adds a page at UPAGE whose first READ_BYTES bytes are read
+   from FILE at offset OFS on first access and whose remainder
+   is zeroed.  Modifications are never written back to FILE.
+   RA is the read-ahead state of the executable. */
+struct page *
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable, struct readahead *ra)
+{
+  return page_add_backed (upage, PAGE_FILE, file, ofs, read_bytes,
+                          writable, ra);
+}
+
+/* Adds a writable page at UPAGE mapping READ_BYTES bytes of
+   FILE at offset OFS.  The page is read in on first access and
+   written back to FILE when it is evicted or removed while
+   dirty.  RA is the read-ahead state of the mapping. */
+struct page *
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, struct readahead *ra)
+{
+  return page_add_backed (upage, PAGE_MMAP, file, ofs, read_bytes, true,
+                          ra);
+}
+
+/* Adds an all-zero page at UPAGE. */
+struct page *
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, PAGE_ZERO, writable);
+}
+
+/* Removes page P from the current thread's supplemental page
+   table, writing it back if it is a dirty memory-mapped page,
+   and frees it. */
+void
+page_remove (struct page *p)
+{
+  page_release (p, NULL);
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+  free (p);
+}
+
+/* Returns true if user address UADDR lies in the region
+   reserved for the stack. */
+bool
+page_is_stack (const void *uaddr)
+{
+  return is_user_vaddr (uaddr)
+         && pg_no (PHYS_BASE) - pg_no (uaddr) <= stack_page_limit;
+}
+
+/* Returns true if an access to UADDR, with the user stack
+   pointer at ESP, should grow the stack.  PUSHA faults up to 32
+   bytes below ESP before ESP is updated, so accesses that far
+   down are allowed too. */
+bool
+page_is_stack_access (const void *uaddr, const void *esp)
+{
+  return page_is_stack (uaddr)
+         && (const uint8_t *) uaddr + 32 >= (const uint8_t *) esp;
+}
+
+/* Adds a zero page to the current thread's stack at UADDR, if
+   an access there with the user stack pointer at ESP should
+   grow the stack.  Returns the new page, or a null pointer. */
+static struct page *
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  if (!page_is_stack_access (uaddr, esp))
+    return NULL;
+  return page_add_zero (pg_round_down (uaddr), true);
+}
+
+/* Reads page P's file data into KPAGE and zeroes the rest.
+   Returns true if successful. */
+static bool
+page_read_file (struct page *p, void *kpage)
+{
+  off_t read = file_read_at (p->file, kpage, p->read_bytes, p->file_ofs);
+
+  if (read != (off_t) p->read_bytes)
+    return false;
+  memset ((uint8_t *) kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  return true;
+}
+
+/* Writes the file-backed part of page P from KPAGE back to its
+   file. */
+static void
+page_write_file (struct page *p, const void *kpage)
+{
+  file_write_at (p->file, kpage, p->read_bytes, p->file_ofs);
+}
+
+/* Waits until page P is no longer being written back by an
+   eviction.  The caller must hold the frame lock. */
+static void
+page_wait_writeback (struct page *p)
+{
+  while (p->writeback)
+    frame_lock_wait ();
+}
+
+/* Brings non-resident page P into a frame and maps it into the
+   current thread's page directory.  Read-only executable pages
+   reuse the frame of any other process running the same
+   program; other pages get a new frame, which may evict another
+   page only if MODE is PAGE_IN_FAULT.  If MODE is
+   PAGE_IN_CACHED, only a frame already in memory is used.  The
+   frame is left pinned.  A demand fault is counted as major if
+   P has to be read from disk or swap, as minor otherwise.
+   Returns true if successful. */
+static bool
+page_in (struct page *p, enum page_in_mode mode)
+{
+  struct thread *t = thread_current ();
+  struct inode *text = NULL;
+  struct frame *f = NULL;
+  bool major = false;
+  bool success = true;
+
+  if (p->type == PAGE_MMAP)
+    {
+      /* Do not read the file before an eviction's write back to
+         it is done. */
+      frame_lock_acquire ();
+      page_wait_writeback (p);
+      frame_lock_release ();
+    }
+  ASSERT (p->frame == NULL);
+
+  if (p->type == PAGE_FILE && !p->writable)
+    {
+      text = file_get_inode (p->file);
+      frame_lock_acquire ();
+      f = frame_find_text (text, p->file_ofs, p->read_bytes);
+      if (f != NULL)
+        {
+          frame_pin (f);
+          frame_attach (f, p);
+        }
+      frame_lock_release ();
+    }
+
+  if (f == NULL)
+    {
+      enum palloc_flags flags = p->type == PAGE_ZERO ? PAL_ZERO : 0;
+
+      if (mode == PAGE_IN_CACHED)
+        return false;
+      f = (mode == PAGE_IN_FAULT
+           ? frame_alloc (flags, p) : frame_try_alloc (flags, p));
+      if (f == NULL)
+        return false;
+
+      switch (p->type)
+        {
+        case PAGE_ZERO:
+          break;
+        case PAGE_FILE:
+        case PAGE_MMAP:
+          major = true;
+          success = page_read_file (p, f->kpage);
+          break;
+        case PAGE_SWAP:
+          major = true;
+          swap_in (p->swap_slot, f->kpage);
+          swap_free (p->swap_slot);
+          p->swap_slot = SWAP_ERROR;
+          break;
+        }
+
+      if (success && text != NULL)
+        {
+          frame_lock_acquire ();
+          frame_set_text (f, text, p->file_ofs, p->read_bytes);
+          frame_lock_release ();
+        }
+    }
+
+  if (!success
+      || !pagedir_set_page (t->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_lock_acquire ();
+      frame_detach (p, NULL);
+      frame_unpin (f);
+      frame_lock_release ();
+      return false;
+    }
+
+  if (mode == PAGE_IN_FAULT)
+    {
+      if (major)
+        t->usage.majflt++;
+      else
+        t->usage.minflt++;
+    }
+  return true;
+}
+
+/* Brings in page P with page_in() in the given MODE and unpins
+   its frame.  Returns true if successful. */
+static bool
+page_in_unpinned (struct page *p, enum page_in_mode mode)
+{
+  if (!page_in (p, mode))
+    return false;
+  frame_lock_acquire ();
+  frame_unpin (p->frame);
+  frame_lock_release ();
+  return true;
+}
+
+/* Brings page P into memory and maps it.  Returns true if
+   successful. */
+bool
+page_load (struct page *p)
+{
+  return page_in_unpinned (p, PAGE_IN_FAULT);
+}
+
+/* Maps the read-only executable pages in the aligned block of
+   fault_around_pages pages around P, which was just faulted in,
+   that other processes already hold in memory.  Mapping them now
+   costs no I/O and saves a fault on each. */
+static void
+page_map_around (struct page *p)
+{
+  size_t block = fault_around_pages > 0 ? fault_around_pages : 1;
+  uint8_t *start, *end, *upage;
+
+  if (p->type != PAGE_FILE)
+    return;
+
+  start = (uint8_t *) p->upage - pg_no (p->upage) % block * PGSIZE;
+  end = start + block * PGSIZE;
+  for (upage = start; upage < end && is_user_vaddr (upage);
+       upage += PGSIZE)
+    {
+      struct page *q = page_lookup (upage);
+
+      if (q != NULL && q->frame == NULL
+          && q->type == PAGE_FILE && !q->writable)
+        page_in_unpinned (q, PAGE_IN_CACHED);
+    }
+}
+
+/* Reads ahead of P, which was just faulted in.  A fault on the
+   page where the previous read-ahead window of P's region ended
+   is sequential and doubles the window, up to readahead_pages;
+   any other fault resets it to P alone.  Stops early at the end
+   of the region or when no free frame is left. */
+static void
+page_read_ahead (struct page *p)
+{
+  struct readahead *ra = p->ra;
+  size_t max = readahead_pages > 0 ? readahead_pages : 1;
+  size_t i;
+
+  if (ra == NULL)
+    return;
+
+  if (p->upage == ra->next)
+    ra->window = ra->window * 2 < max ? ra->window * 2 : max;
+  else
+    ra->window = 1;
+  ra->next = (uint8_t *) p->upage + ra->window * PGSIZE;
+
+  for (i = 1; i < ra->window; i++)
+    {
+      struct page *q = page_lookup ((uint8_t *) p->upage + i * PGSIZE);
+
+      if (q == NULL || q->ra != ra)
+        break;
+      if (q->frame == NULL
+          && (q->type == PAGE_FILE || q->type == PAGE_MMAP)
+          && !page_in_unpinned (q, PAGE_IN_READAHEAD))
+        break;
+    }
+}
+
+/* Handles a not-present fault at FAULT_ADDR in the current
+   thread's address space, growing the stack if the user stack
+   pointer is at ESP.  Returns true if the faulting access may be
+   retried, false if FAULT_ADDR is not a valid address. */
+bool
+page_fault_in (const void *fault_addr, const void *esp)
+{
+  struct page *p;
+  bool resident;
+
+  if (!is_user_vaddr (fault_addr) || thread_current ()->pagedir == NULL)
+    return false;
+  p = page_lookup (fault_addr);
+  if (p == NULL)
+    p = page_grow_stack (fault_addr, esp);
+  if (p == NULL)
+    return false;
+
+  /* If P is being evicted, the frame lock is held until the
+     eviction completes, except while a memory-mapped page is
+     written back, which is waited for here.  After that
+     P->frame is stable. */
+  frame_lock_acquire ();
+  page_wait_writeback (p);
+  resident = p->frame != NULL;
+  frame_lock_release ();
+
+  if (resident)
+    {
+      thread_current ()->usage.minflt++;
+      return true;
+    }
+  if (!page_load (p))
+    return false;
+  page_map_around (p);
+  page_read_ahead (p);
+  return true;
+}
+
+/* Handles a write fault at FAULT_ADDR on a present but
+   read-only page of the current thread, which happens when the
+   page is writable but its frame is shared copy-on-write.
+   Returns true if the faulting access may be retried, false if
+   the write is not allowed. */
+bool
+page_fault_cow (const void *fault_addr)
+{
+  struct page *p;
+
+  if (!is_user_vaddr (fault_addr) || thread_current ()->pagedir == NULL)
+    return false;
+  p = page_lookup (fault_addr);
+  if (p == NULL || !p->writable)
+    return false;
+
+  thread_current ()->usage.minflt++;
+  return page_unshare (p);
+}
+
+/* Gives writable page P of the current thread a frame of its
+   own and maps it writable.  If P is the only page left on its
+   frame, the frame is simply remapped writable; otherwise its
+   contents are copied into a new frame.  Returns true if
+   successful, or if P was evicted meanwhile, in which case the
+   next access faults it back in privately. */
+static bool
+page_unshare (struct page *p)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct frame *old, *new;
+  bool dirty;
+
+  ASSERT (p->writable);
+
+  frame_lock_acquire ();
+  old = p->frame;
+  if (old == NULL || !frame_is_shared (old))
+    {
+      if (old != NULL)
+        pagedir_set_writable (pd, p->upage, true);
+      frame_lock_release ();
+      return true;
+    }
+  frame_pin (old);
+  frame_lock_release ();
+
+  /* The old frame is pinned, so P stays on it while we copy. */
+  new = frame_alloc (0, NULL);
+  if (new == NULL)
+    {
+      frame_lock_acquire ();
+      frame_unpin (old);
+      frame_lock_release ();
+      return false;
+    }
+  memcpy (new->kpage, old->kpage, PGSIZE);
+
+  frame_lock_acquire ();
+  dirty = pagedir_is_dirty (pd, p->upage);
+  pagedir_clear_page (pd, p->upage);
+  frame_detach (p, NULL);
+  frame_unpin (old);
+  if (!pagedir_set_page (pd, p->upage, new->kpage, true))
+    PANIC ("page table missing for mapped page");
+  pagedir_set_dirty (pd, p->upage, dirty);
+  frame_attach (new, p);
+  frame_unpin (new);
+  frame_lock_release ();
+  return true;
+}
+
+/* Unmaps every page mapping frame F and saves F's contents to
+   backing store if necessary, so that F can be reused.  Clean
+   file and zero pages are simply dropped and re-read on the
+   next fault; dirty memory-mapped pages are written back to
+   their file and other dirty pages go to swap, in one slot
+   shared by all of F's pages.  Called by the frame table with
+   the frame lock held, which is released while a memory-mapped
+   page is written back.  F stays pinned by the caller. */
+void
+page_evict (struct frame *f)
+{
+  struct list_elem *e;
+  struct page *p;
+  bool dirty = false;
+
+  ASSERT (!list_empty (&f->pages));
+
+  /* Clear the mappings first, so that no owner can modify the
+     page while it is being written out. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      uint32_t *pd;
+
+      p = list_entry (e, struct page, frame_elem);
+      pd = p->thread->pagedir;
+      pagedir_clear_page (pd, p->upage);
+      dirty = dirty || pagedir_is_dirty (pd, p->upage);
+    }
+
+  /* Pages sharing a frame, whether through fork() or as
+     executable text, always have the same type, and
+     memory-mapped pages are never shared. */
+  p = list_entry (list_front (&f->pages), struct page, frame_elem);
+  if (p->type == PAGE_MMAP)
+    {
+      if (dirty)
+        {
+          /* Detach P before releasing the frame lock, so that its
+             owner sees it as not resident and waits for the
+             write in page_wait_writeback(). */
+          list_remove (&p->frame_elem);
+          p->frame = NULL;
+          p->thread->usage.rss--;
+          p->writeback = true;
+          frame_lock_release ();
+          page_write_file (p, f->kpage);
+          frame_lock_acquire ();
+          p->writeback = false;
+          frame_lock_wake ();
+        }
+    }
+  else if (dirty || p->type == PAGE_SWAP)
+    {
+      swap_slot_t slot = swap_out (f->kpage);
+      if (slot == SWAP_ERROR)
+        PANIC ("out of swap space");
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          p = list_entry (e, struct page, frame_elem);
+          p->type = PAGE_SWAP;
+          p->swap_slot = swap_dup (slot);
+        }
+      swap_free (slot);
+    }
+
+  while (!list_empty (&f->pages))
+    {
+      p = list_entry (list_pop_front (&f->pages), struct page, frame_elem);
+      p->frame = NULL;
+      p->thread->usage.rss--;
+    }
+}
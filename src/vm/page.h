@@ -0,0 +1,93 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "vm/swap.h"
+
+/* Default maximum size of a user stack, in pages (8 MB). */
+#define STACK_PAGES_DEFAULT 2048
+
+/* Maximum size of a user stack, in pages.  Set with -stk. */
+extern size_t stack_page_limit;
+
+/* Default fault-around and read-ahead window sizes, in pages. */
+#define FAULT_AROUND_DEFAULT 16
+#define READAHEAD_DEFAULT 32
+
+/* Size of the aligned block of pages around a fault in which
+   pages already in memory are mapped too.  Set with -fa. */
+extern size_t fault_around_pages;
+
+/* Maximum number of pages read ahead of a sequential fault.
+   Set with -ra. */
+extern size_t readahead_pages;
+
+/* Read-ahead state of a file-backed region, that is, a
+   process's executable or one memory mapping. */
+struct readahead
+  {
+    void *next;                 /* Page a sequential fault would hit. */
+    size_t window;              /* Pages brought in by last fault. */
+  };
+
+/* Where a page's contents come from when it is not resident. */
+enum page_type
+  {
+    PAGE_ZERO,                  /* All zeros, e.g. stack or bss. */
+    PAGE_FILE,                  /* Executable segment read from a file. */
+    PAGE_MMAP,                  /* Memory-mapped file, written back. */
+    PAGE_SWAP                   /* Contents live on the swap device. */
+  };
+
+/* A page of a process's virtual address space, as recorded in
+   its supplemental page table.  The page's PTE may be read-only
+   even though WRITABLE is true, while its frame is shared
+   copy-on-write with a forked process. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct thread *thread;      /* Owning process. */
+    bool writable;              /* Writable by the user? */
+    enum page_type type;        /* Backing store. */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    struct list_elem frame_elem; /* Element in frame's page list. */
+    bool writeback;             /* Being written back by eviction? */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read from. */
+    off_t file_ofs;             /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest is zeroed. */
+    struct readahead *ra;       /* Read-ahead state of the region. */
+
+    /* PAGE_SWAP only. */
+    swap_slot_t swap_slot;      /* Slot holding the page, or SWAP_ERROR. */
+
+    struct hash_elem hash_elem; /* Element in supplemental page table. */
+  };
+
+bool page_table_init (void);
+bool page_table_fork (struct thread *parent);
+void page_table_destroy (void);
+
+struct page *page_lookup (const void *uaddr);
+struct page *page_add_file (void *upage, struct file *, off_t ofs,
+                            size_t read_bytes, bool writable,
+                            struct readahead *);
+struct page *page_add_mmap (void *upage, struct file *, off_t ofs,
+                            size_t read_bytes, struct readahead *);
+struct page *page_add_zero (void *upage, bool writable);
+void page_remove (struct page *);
+bool page_is_stack (const void *uaddr);
+bool page_is_stack_access (const void *uaddr, const void *esp);
+
+bool page_load (struct page *);
+bool page_fault_in (const void *fault_addr, const void *esp);
+bool page_fault_cow (const void *fault_addr);
+void page_evict (struct frame *);
+
+#endif /* vm/page.h */
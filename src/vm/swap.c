@@ -0,0 +1,254 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <lz.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap manager.  The BLOCK_SWAP device is divided into
+   page-sized slots of SECTORS_PER_SLOT sectors each, and a
+   bitmap records which slots are in use.  A slot may be shared
+   by the copies of a page in forked processes, so each slot also
+   has a reference count and is freed when the last one drops.
+
+   Writing a page to the device takes 8 sector writes, so pages
+   first go to a cache that keeps them compressed in kernel
+   memory.  Only pages that do not compress well, or that would
+   take the cache over its budget, are written to the device.
+   Cache entries are numbered after the device's slots, so that
+   callers see a single slot space. */
+
+/* Number of sectors needed to hold one page. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Compressed cache limits. */
+#define CACHE_SLOTS 1024            /* Maximum number of entries. */
+#define CACHE_BYTES (256 * 1024)    /* Total compressed bytes. */
+#define CACHE_MAX_ENTRY (PGSIZE / 2) /* Largest compressed page. */
+
+/* A page in the compressed cache. */
+struct cache_entry
+  {
+    void *data;                 /* Compressed contents. */
+    size_t size;                /* Size of DATA in bytes. */
+  };
+
+static struct block *swap_device;   /* Swap device, or null. */
+static size_t disk_slots;           /* Number of slots on the device. */
+static struct bitmap *swap_map;     /* Used device slots. */
+static struct bitmap *cache_map;    /* Used cache entries. */
+static struct cache_entry *cache;   /* Cache entries. */
+static size_t cache_bytes;          /* Compressed bytes in cache. */
+static unsigned *swap_refs;         /* Reference count of each slot. */
+static struct lock swap_lock;       /* Protects all of the above. */
+
+/* Scratch space for compression, protected by swap_lock. */
+static uint8_t cache_buf[CACHE_MAX_ENTRY];
+static uint8_t cache_work[LZ_WORK_SIZE];
+
+/* Statistics. */
+static unsigned long long cache_stores;     /* Pages put in cache. */
+static unsigned long long cache_store_bytes; /* Their compressed size. */
+static unsigned long long cache_rejects;    /* Pages that didn't fit. */
+static unsigned long long cache_hits;       /* Pages read from cache. */
+static unsigned long long disk_writes;      /* Pages written to device. */
+static unsigned long long disk_reads;       /* Pages read from device. */
+
+static swap_slot_t cache_store (const void *kpage);
+
+/* Initializes the swap manager.  If no swap device is present,
+   evicted pages can only go to the compressed cache. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    disk_slots = block_size (swap_device) / SECTORS_PER_SLOT;
+  else
+    printf ("swap: no swap device, using compressed cache only\n");
+
+  swap_map = bitmap_create (disk_slots);
+  cache_map = bitmap_create (CACHE_SLOTS);
+  cache = calloc (CACHE_SLOTS, sizeof *cache);
+  swap_refs = calloc (disk_slots + CACHE_SLOTS, sizeof *swap_refs);
+  if (swap_map == NULL || cache_map == NULL || cache == NULL
+      || swap_refs == NULL)
+    PANIC ("swap: slot table allocation failed");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot, or SWAP_ERROR if both the cache and the swap device are
+   full. */
+swap_slot_t
+swap_out (const void *kpage)
+{
+  swap_slot_t slot;
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  slot = cache_store (kpage);
+  if (slot != SWAP_ERROR)
+    {
+      lock_release (&swap_lock);
+      return slot;
+    }
+  slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    {
+      swap_refs[slot] = 1;
+      disk_writes++;
+    }
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  return slot;
+}
+
+/* Reads SLOT into the page at KPAGE.  The slot stays allocated;
+   the caller releases its reference with swap_free(). */
+void
+swap_in (swap_slot_t slot, void *kpage)
+{
+  size_t i;
+
+  ASSERT (slot != SWAP_ERROR);
+
+  if (slot >= disk_slots)
+    {
+      struct cache_entry *e = &cache[slot - disk_slots];
+      size_t size;
+
+      lock_acquire (&swap_lock);
+      size = lz_decompress (e->data, e->size, kpage, PGSIZE);
+      ASSERT (size == PGSIZE);
+      cache_hits++;
+      lock_release (&swap_lock);
+      return;
+    }
+
+  lock_acquire (&swap_lock);
+  disk_reads++;
+  lock_release (&swap_lock);
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Adds a reference to SLOT, so that it survives one more
+   swap_free().  Returns SLOT. */
+swap_slot_t
+swap_dup (swap_slot_t slot)
+{
+  ASSERT (slot != SWAP_ERROR);
+
+  lock_acquire (&swap_lock);
+  ASSERT (swap_refs[slot] > 0);
+  swap_refs[slot]++;
+  lock_release (&swap_lock);
+  return slot;
+}
+
+/* Drops a reference to SLOT, releasing the slot when no
+   references remain. */
+void
+swap_free (swap_slot_t slot)
+{
+  ASSERT (slot != SWAP_ERROR);
+
+  lock_acquire (&swap_lock);
+  ASSERT (swap_refs[slot] > 0);
+  if (--swap_refs[slot] == 0)
+    {
+      if (slot >= disk_slots)
+        {
+          struct cache_entry *e = &cache[slot - disk_slots];
+          cache_bytes -= e->size;
+          free (e->data);
+          e->data = NULL;
+          bitmap_reset (cache_map, slot - disk_slots);
+        }
+      else
+        bitmap_reset (swap_map, slot);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Returns true if the swap device has no free slot left, so
+   that swap_out() fails unless the page fits in the compressed
+   cache. */
+bool
+swap_is_full (void)
+{
+  bool full;
+
+  lock_acquire (&swap_lock);
+  full = bitmap_all (swap_map, 0, disk_slots);
+  lock_release (&swap_lock);
+  return full;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  unsigned long long ins = cache_hits + disk_reads;
+
+  printf ("Swap: %llu pages out, %llu to cache, %llu to disk; "
+          "%llu pages in, %llu%% from cache\n",
+          cache_stores + disk_writes, cache_stores, disk_writes,
+          ins, ins > 0 ? cache_hits * 100 / ins : 0);
+  printf ("Swap cache: %llu%% average compressed size, "
+          "%llu pages rejected\n",
+          cache_stores > 0 ? cache_store_bytes * 100
+                             / (cache_stores * PGSIZE) : 0,
+          cache_rejects);
+}
+
+/* Tries to compress the page at KPAGE into the cache.  Returns
+   its slot, or SWAP_ERROR if it compresses poorly or the cache
+   is full.  The caller must hold swap_lock. */
+static swap_slot_t
+cache_store (const void *kpage)
+{
+  struct cache_entry *e;
+  size_t size, idx;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  size = lz_compress (kpage, PGSIZE, cache_buf, sizeof cache_buf,
+                      cache_work);
+  if (size == 0 || cache_bytes + size > CACHE_BYTES)
+    goto reject;
+  idx = bitmap_scan_and_flip (cache_map, 0, 1, false);
+  if (idx == BITMAP_ERROR)
+    goto reject;
+
+  e = &cache[idx];
+  e->data = malloc (size);
+  if (e->data == NULL)
+    {
+      bitmap_reset (cache_map, idx);
+      goto reject;
+    }
+  memcpy (e->data, cache_buf, size);
+  e->size = size;
+  cache_bytes += size;
+  swap_refs[disk_slots + idx] = 1;
+
+  cache_stores++;
+  cache_store_bytes += size;
+  return disk_slots + idx;
+
+ reject:
+  cache_rejects++;
+  return SWAP_ERROR;
+}
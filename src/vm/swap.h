@@ -0,0 +1,19 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Index of a page-sized swap slot. */
+typedef size_t swap_slot_t;
+#define SWAP_ERROR ((swap_slot_t) -1)
+
+void swap_init (void);
+swap_slot_t swap_out (const void *kpage);
+void swap_in (swap_slot_t, void *kpage);
+swap_slot_t swap_dup (swap_slot_t);
+void swap_free (swap_slot_t);
+bool swap_is_full (void);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */